@@ -1,9 +1,30 @@
 #pragma once
 #include <memory>
 #include <bitset>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
 #include "glm/glm.hpp"
+#include "gradientnoise.h"
+#include "entities.h"
 
 #define MAX_FPS 60.0
+//Width & depth of a column of blocks meshed & drawn together
+#define CHUNK_SIZE 16
+//Bytes allocated past a map's last block, so SIMD gathers of 4 bytes from any block stay in bounds
+#define MAP_PADDING 3
+//Levels of the occupancy pyramid from 1 whose counts, at most 64, are kept in bytes
+#define BYTE_LEVELS 2
+//Depth of the slabs fills update the occupancy pyramid for at a time, a whole number of level 1 cells
+#define COUNT_SLAB 16
+//Level of the occupancy pyramid whose cells are chunk sections, CHUNK_SIZE blocks a side
+#define SECTION_LEVEL 4
+//Gap boxes are stopped short of blocks they slide against, less than blockBaseOffset
+#define SWEEP_SKIN 0.001f
+
+class Heightfield;
 
 typedef char MovementFlags;
 
@@ -19,7 +40,9 @@ enum PlayerMovement {
 struct EngineInitData {
     unsigned int mapDimensionsXYZ[3];
     float mouseSensitivity = 0.1;
-    float playerSpeed = 0.2;
+    float playerSpeed = 12.0; //units per second
+    float tickRate = 60.0; //simulation ticks per second, independent of frame rate
+    int maxTicksPerFrame = 5; //bound on catch-up ticks after a slow frame
     float gravity = 9.81;
     float jumpForce = 700;
     float blockBaseOffset = 0.01;
@@ -27,15 +50,40 @@ struct EngineInitData {
     glm::vec3 playerDimensions;
 };
 
+//Parameters for generating terrain from seeded fractal noise, see seededFractalNoise
+struct TerrainParams {
+    uint32_t seed = 1;
+    int cellSize = 32;
+    int octaves = 5;
+    float lacunarity = 1.5;
+    float persistence = 0.5;
+    float maxY = 48; //height of a column at noise value 1
+    NoiseLattice lattice = NoiseLattice::Square;
+    //3D density moving the surface up or down for overhangs & caves, see seededFractalNoise3D
+    float densityAmplitude = 0; //most blocks the surface moves, 0 keeps terrain a heightmap
+    int densityCellSize = 16;
+    int densityOctaves = 2;
+    //Hydraulic erosion iterations over the whole map's heightmap first, 0 skips erosion, see erodeHeightmap
+    int erosionIterations = 0;
+};
+
+//First contact of a box swept through the map
+struct SweepHit {
+    float time;         //fraction of the motion made before contact
+    glm::ivec3 normal;  //outward normal of the block face hit
+};
+
 class Player {
 public:
     Player(glm::vec3 spawnPosition, glm::vec3 dimensions) 
             : _movementFlags(), _falling(true), _yaw(), _yVelocity(),
-            _yAcceleration(), _position(spawnPosition), _dimensions(dimensions) {}
-    void move();
+            _yAcceleration(), _position(spawnPosition), _prevPosition(spawnPosition),
+            _dimensions(dimensions) {}
+    void move(glm::vec3 offset);
     void setMoving(PlayerMovement direction, bool moving);
     void setFalling(bool falling);
-    void applyGravity(float timeStep);
+    //Integrate vertical velocity, returning the height to move by, which collision may cut short
+    float applyGravity(float timeStep);
     void resetGravity();
     void incrementYaw(float amount);
     inline void setGravity(float gravity) { _gravity = gravity; }
@@ -43,10 +91,14 @@ public:
     inline void setJumpForce(float jumpForce) {_jumpForce = jumpForce; }
     inline void setBlockBaseOffset(float blockBaseOffset) { _blockBaseOffset = blockBaseOffset; }
     inline glm::vec3 getCurrentPosition() const { return _position; }
-    glm::vec3 getNextPosition();
+    //Position at the start of the current tick, kept for render interpolation
+    inline void savePosition() { _prevPosition = _position; }
+    inline glm::vec3 getPreviousPosition() const { return _prevPosition; }
+    inline glm::vec3 getInterpolatedPosition(float alpha) const { return glm::mix(_prevPosition, _position, alpha); }
+    glm::vec3 getNextPosition(float timeStep);
     inline glm::vec3 getDimensions() const { return _dimensions; }
     inline bool getFalling() { return _falling; }
-    inline float getYaw() { return _yaw; }
+    inline float getYaw() const { return _yaw; }
 private:
     bool _falling;
     MovementFlags _movementFlags;
@@ -58,49 +110,195 @@ private:
     float _jumpForce;
     float _blockBaseOffset;
     glm::vec3 _position;
+    glm::vec3 _prevPosition;
     glm::vec3 _dimensions;
 };
 
 class Map {
 public:
-    Map(unsigned int xDimensions, unsigned int yDimensions, unsigned int zDimensions) :
-        _xDim(xDimensions), _yDim(yDimensions), _zDim(zDimensions), 
-        _map(new bool[xDimensions*yDimensions*zDimensions]) {}
+    Map(unsigned int xDimensions, unsigned int yDimensions, unsigned int zDimensions);
     void fromHeightmap(float *heightmap, float maxY);
+    /*Fill the columns of a width*depth area at (x0, z0) up to heights * maxY, as
+    fromHeightmap. Writes whole rows of blocks at a time rather than one setAt
+    per block: layers below every column in a row are filled solid & layers
+    above all of them cleared in one go, only layers in between are compared per
+    column. Areas that don't overlap may be filled from different threads.*/
+    void fillColumns(int x0, int z0, int width, int depth, const float *heights, float maxY);
+    /*Fill a box of blocks at (x0, y0, z0) from 3D density laid out as
+    seededNoise3D. A block is solid if it would be under fillColumns' surface moved
+    by amplitude * (2 * density - 1), so density 0.5 leaves fillColumns' result.*/
+    void fillDensity(int x0, int y0, int z0, int width, int height, int depth, const float *heights, float maxY,
+        const float *density, float amplitude);
     bool planeIntersectsMap(glm::vec3 position, glm::vec2 dimensions);
     bool cuboidIntersectsMap(glm::vec3 position, glm::vec3 dimensions);
+    /*Whether any block from (x0, y0, z0) to (x1, y1, z1) inclusive is solid,
+    blocks outside the map counting as air. Descends the occupancy pyramid from
+    the smallest cell holding the region, skipping empty cells & stopping at the
+    first solid cell inside the region or full cell overlapping it.*/
+    bool regionHasSolid(int x0, int y0, int z0, int x1, int y1, int z1) const;
+    /*Solid blocks from (x0, y0, z0) to (x1, y1, z1) inclusive, blocks outside
+    the map counting as air. Constant time per chunk section the region overlaps:
+    sections it covers, or that are empty or full, take their count from the
+    occupancy pyramid, others sum 8 corners of the section's summed-volume table.
+    Tables are built when first needed & again after the section changes.*/
+    int countSolid(int x0, int y0, int z0, int x1, int y1, int z1) const;
+    //Solid blocks overlapping the box from min to max, touching it only at a face not counting
+    int countSolid(glm::vec3 min, glm::vec3 max) const;
+    /*Sweep the box from min to max along motion, true if it enters a solid block.
+    Steps through the layers of blocks the box's leading faces cross with 3D DDA,
+    testing each layer entered across the box's extent on the other axes, so fast
+    boxes can't pass through thin walls. Blocks the box already overlaps don't stop
+    it, so it can move out of them.*/
+    bool sweepBox(glm::vec3 min, glm::vec3 max, glm::vec3 motion, SweepHit& hit) const;
+    /*Move the box along motion, sliding along blocks hit: at each contact motion
+    into the face hit is dropped & the rest carried on, resolving one axis at a
+    time. Returns the offset made, axes stopped on are set in blocked if given.*/
+    glm::vec3 slideBox(glm::vec3 min, glm::vec3 max, glm::vec3 motion, glm::bvec3 *blocked = NULL) const;
     bool at(int x, int y, int z) const;
     bool at(glm::vec3 pos) const;
+    //All blocks, block (x, y, z) at x + y * getXDim() * getZDim() + z * getXDim()
+    inline const bool *getBlocks() const { return _map.get(); }
+    //Blocks of row (y, z) along x, getXDim() of them
+    inline const bool *row(int y, int z) const { return &_map[y * _xDim * _zDim + z * _xDim]; }
+    //Sets a block, updating the cells holding it on every level of the occupancy pyramid
     void setAt(int x, int y, int z, bool value);
+    /*Occupancy pyramid: level l has cells of 2^l blocks a side, level 0 being
+    blocks, up to the level whose one cell covers the map. Cells are laid out as
+    blocks, cell (x, y, z) of level l holding blocks from (x, y, z) * 2^l. Blocks
+    outside the map count as air, so cells over the map's edge are never full.*/
+    inline int getOccupancyLevels() const { return _byteOccupancy.size() + _occupancy.size() + 1; }
+    inline glm::ivec3 getOccupancyDims(int level) const
+    {
+        return {(_xDim + (1 << level) - 1) >> level, (_yDim + (1 << level) - 1) >> level,
+            (_zDim + (1 << level) - 1) >> level};
+    }
+    //Solid blocks in a cell, for level 1 up
+    inline uint32_t occupancy(int level, int x, int y, int z) const
+    {
+        glm::ivec3 dims = getOccupancyDims(level);
+        size_t cell = x + y * dims.x * dims.z + z * dims.x;
+        if (level <= BYTE_LEVELS) return _byteOccupancy[level - 1][cell].load(std::memory_order_relaxed);
+        return _occupancy[level - BYTE_LEVELS - 1][cell].load(std::memory_order_relaxed);
+    }
+    //Cells of a level above BYTE_LEVELS, for reading many at once
+    inline const std::atomic<uint32_t> *getOccupancy(int level) const { return _occupancy[level - BYTE_LEVELS - 1].get(); }
+    inline bool cellHasSolid(int level, int x, int y, int z) const
+    {
+        return level ? occupancy(level, x, y, z) != 0 : at(x, y, z);
+    }
+    inline bool cellIsSolid(int level, int x, int y, int z) const
+    {
+        return level ? occupancy(level, x, y, z) == (uint64_t)1 << 3 * level : at(x, y, z);
+    }
+    /*Height of the column at (x, z), one above its highest solid block, 0 if it
+    has none or is outside the map. Kept by setAt & the fills, which only scan a
+    column again when its highest block is cleared.*/
+    inline int columnHeight(int x, int z) const
+    {
+        if (x < 0 || z < 0 || x >= (int)_xDim || z >= (int)_zDim) return 0;
+        return _heights[x + z * _xDim];
+    }
+    //columnHeight for a width*depth area at (x0, z0), in rows along x
+    void columnHeights(int x0, int z0, int width, int depth, int *heights) const;
     std::bitset<6> surroundingBlocks(int x, int y, int z) const;
+    inline unsigned int getXDim() const { return _xDim; }
+    inline unsigned int getYDim() const { return _yDim; }
+    inline unsigned int getZDim() const { return _zDim; }
+    inline int getChunksX() const { return (_xDim + CHUNK_SIZE - 1) / CHUNK_SIZE; }
+    inline int getChunksZ() const { return (_zDim + CHUNK_SIZE - 1) / CHUNK_SIZE; }
 private:
+    /*Call write for slabs of the box from low to high (exclusive) along z,
+    COUNT_SLAB blocks deep, adding the difference each makes to the occupancy
+    pyramid, & mark the box's sections edited before & after. write may only
+    change blocks in the box within the slab.*/
+    void writeCounted(glm::ivec3 low, glm::ivec3 high, const std::function<void(int, int)>& write);
+    inline glm::ivec3 getSectionDims() const { return getOccupancyDims(SECTION_LEVEL); }
+    /*Mark the summed-volume tables of sections from low to high (exclusive) out
+    of date, called before & after changing their blocks*/
+    void editSections(glm::ivec3 low, glm::ivec3 high);
+    //The section's summed-volume table, built if out of date, held for as long as it's read
+    std::shared_ptr<const uint16_t[]> volumeTable(glm::ivec3 section) const;
+    //Height of the column at (x, z) counting only blocks below y
+    int heightBelow(int x, int z, int y) const;
+    //Whether a cell of the pyramid has a solid block from low to high inclusive
+    bool cellOverlapsSolid(int level, glm::ivec3 cell, glm::ivec3 low, glm::ivec3 high) const;
     std::unique_ptr<bool[]> _map;
     unsigned int _xDim, _yDim, _zDim;
+    //columnHeight per column, laid out as rows along x
+    std::unique_ptr<int[]> _heights;
+    //Solid blocks per cell of levels 1 to BYTE_LEVELS of the occupancy pyramid, then of the levels above
+    std::vector<std::unique_ptr<std::atomic<uint8_t>[]>> _byteOccupancy;
+    std::vector<std::unique_ptr<std::atomic<uint32_t>[]>> _occupancy;
+    /*Summed-volume table per chunk section: solid blocks from the section's
+    first block to each block, with a zero plane before each axis. Tables are
+    never changed once published, a rebuilt one replaces it atomically. Edits made
+    to each section, & the edit count its table was last built at.*/
+    mutable std::unique_ptr<std::shared_ptr<const uint16_t[]>[]> _volumeTables;
+    std::unique_ptr<std::atomic<uint32_t>[]> _sectionEdits;
+    mutable std::unique_ptr<std::atomic<uint32_t>[]> _volumesBuilt;
+    mutable std::mutex _volumeMutex;
 };
 
 class Engine {
 public:
     Engine(EngineInitData e) :
             _map(e.mapDimensionsXYZ[0], e.mapDimensionsXYZ[1], e.mapDimensionsXYZ[2]),
-            _player(e.spawnPoint, e.playerDimensions), _initData(e) {
+            _player(e.spawnPoint, e.playerDimensions), _initData(e), _mouseMoved(false),
+            _camPitch(), _tickStep(1.0 / e.tickRate), _accumulator(), _tickCount() {
         _player.setGravity(e.gravity);
         _player.setJumpForce(e.jumpForce);
         _player.setSpeed(e.playerSpeed);
         _player.setBlockBaseOffset(e.blockBaseOffset);
         //initial location update after player members set, avoid undefined behaviour.
-        update();
+        tick();
+        updateCamera(1.0f);
     }
     void cursorMoved(double xpos, double ypos);
     void setPlayerMoving(PlayerMovement direction, bool moving);
-    void update();
+    void tick();
+    float advance(double frameTime);
     void loadHeightmap(float *heightmap, float maxY);
+    /*Generate one chunk's terrain straight from noise, without a full size
+    heightmap. Chunks can be generated in any order & from different threads
+    before the simulation starts, they aren't marked dirty. With 3D density, only
+    sections of the chunk that the surface's height range plus the density
+    amplitude can reach sample 3D noise, the rest are provably uniform & come from
+    the heightmap. Returns the number of sections sampled. Heights are taken from
+    heightmap instead if given, covering the whole map row by row along x, so they
+    can be eroded first.*/
+    int generateChunk(const TerrainParams& params, int chunkX, int chunkZ, const float *heightmap = NULL);
+    /*Fill one chunk from a heightfield's mip level, block (0, 0) of the map taking
+    the level's sample (x0, z0). Reads only the samples the chunk covers, so
+    rasters far larger than memory can be loaded chunk by chunk, from any thread.*/
+    void loadHeightfieldChunk(const Heightfield& field, int level, int x0, int z0, float maxY, int chunkX, int chunkZ);
+    void setBlock(int x, int y, int z, bool value);
+    void takeDirtyChunks(std::vector<int>& out);
     const Map& getMap() const { return _map; }
+    const Player& getPlayer() const { return _player; }
+    //Entities besides the player, updated every tick
+    EntityStore& getEntities() { return _entities; }
+    const EntityStore& getEntities() const { return _entities; }
     const glm::mat4& getCamera() const { return _camera; }
+    inline float getCamPitch() const { return _camPitch; }
+    inline float getMouseSensitivity() const { return _initData.mouseSensitivity; }
+    //Last cursor position applied to the camera, false if the cursor hasn't moved yet
+    inline bool getLastCursor(double& x, double& y) const { x = _lastMouseX; y = _lastMouseY; return _mouseMoved; }
+    inline unsigned long getTickCount() const { return _tickCount; }
+    inline double getTickStep() const { return _tickStep; }
 private:
-    bool _mouseMoved;
-    float _lastMouseX, _lastMouseY, _camPitch;
+    void updateCamera(float alpha);
     Map _map;
     Player _player;
+    EntityStore _entities;
     EngineInitData _initData;
+    bool _mouseMoved;
+    double _lastMouseX, _lastMouseY;
+    float _camPitch;
+    double _tickStep, _accumulator;
+    unsigned long _tickCount;
+    std::vector<int> _dirtyChunks;
     glm::mat4 _camera;
-};
\ No newline at end of file
+};
+
+//View matrix for a camera at position, facing along yaw & pitch in degrees
+glm::mat4 cameraMatrix(glm::vec3 position, float yaw, float pitch);
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+/*Single instanced draw of a chunk's squares. Packets are sorted by key, which
+packs state into the high bits and depth into the low bits, so draws sharing
+a program & texture are grouped and each group is drawn front to back.
+*/
+struct DrawPacket {
+    uint64_t key;
+    unsigned int program, texture, vao;
+    unsigned int instances;
+};
+
+//Build a sort key: 8 bits program, 8 bits texture, 24 bits depth, 24 bits chunk
+inline uint64_t drawKey(unsigned int program, unsigned int texture, float depth, int chunk)
+{
+    //Depth in 1/16ths of a block, saturating
+    uint64_t d = depth <= 0.0f ? 0 : depth * 16.0f >= 0xFFFFFF ? 0xFFFFFF : (uint64_t)(depth * 16.0f);
+    return (uint64_t)(program & 0xFF) << 56 | (uint64_t)(texture & 0xFF) << 48
+        | d << 24 | (uint64_t)(chunk & 0xFFFFFF);
+}
+
+/*Packets recorded into one buffer per thread, so recording needs no locking.
+merge() gathers & sorts them on the submitting thread.
+*/
+class CommandBuffer {
+public:
+    //Clear all buffers & make sure there is one per recording thread
+    void reset(unsigned int threads);
+    inline void record(unsigned int thread, const DrawPacket& packet) { _threadPackets[thread].push_back(packet); }
+    //Merge every thread's packets into one list sorted by key
+    const std::vector<DrawPacket>& merge();
+private:
+    std::vector<std::vector<DrawPacket>> _threadPackets;
+    std::vector<DrawPacket> _sorted;
+};
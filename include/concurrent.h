@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/*Lock-free triple buffer for a single producer & single consumer. The producer
+fills writeBuffer() and publishes it, the consumer calls update() to take the
+latest published buffer. Neither side ever waits on the other; buffers the
+consumer didn't get to in time are overwritten.
+*/
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : _buffers(), _write(0), _read(2), _middle(1) {}
+    //Producer side
+    inline T& writeBuffer() { return _buffers[_write]; }
+    void publish() {
+        unsigned char prev = _middle.exchange(_write | NEW_DATA, std::memory_order_acq_rel);
+        _write = prev & INDEX_MASK;
+    }
+    //Consumer side, returns true if a newer buffer was taken
+    bool update() {
+        if (!(_middle.load(std::memory_order_relaxed) & NEW_DATA)) return false;
+        unsigned char prev = _middle.exchange(_read, std::memory_order_acq_rel);
+        _read = prev & INDEX_MASK;
+        return true;
+    }
+    inline const T& readBuffer() const { return _buffers[_read]; }
+private:
+    static const unsigned char INDEX_MASK = 3;
+    static const unsigned char NEW_DATA = 4;
+    T _buffers[3];
+    unsigned char _write, _read;
+    std::atomic<unsigned char> _middle;
+};
+
+/*Bounded lock-free ring buffer for a single producer & single consumer.
+Capacity must be a power of two. push fails rather than blocks when full.
+*/
+template <typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    SPSCQueue() : _head(0), _tail(0) {}
+    bool push(const T& value) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == Capacity) return false;
+        _items[tail & (Capacity - 1)] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& value) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) return false;
+        value = std::move(_items[head & (Capacity - 1)]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    inline bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+private:
+    T _items[Capacity];
+    //Separate cache lines so producer & consumer don't contend
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+};
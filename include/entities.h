@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "glm/glm.hpp"
+
+class Map;
+class ThreadPool;
+
+//Entities collided per batch, batches are spread over the pool
+#define ENTITY_BATCH 256
+
+//Bits of an entity's flags
+enum EntityFlags {
+    Grounded = 1    //standing on a block, so not accelerated by gravity
+};
+
+/*Simulated boxes, such as mobs, stored as one array per component so each
+system streams only the components it uses. An entity is a box of size above
+its position, which is the centre of its base. Entities are indices, removing
+one moves the last entity into its place.
+
+update runs the physics systems over every entity: vertical velocity Verlet
+with gravity (simdKernels().verletStep), then collision & ground detection,
+sweeping each box through the map (Map::slideBox). Entities only read the map
+& their own components, so batches of them run on any thread.
+*/
+class EntityStore {
+public:
+    //Index of the new entity
+    int spawn(glm::vec3 position, glm::vec3 size, glm::vec3 velocity = glm::vec3(0.0f));
+    //Remove an entity, the last entity takes its index
+    void despawn(int entity);
+    void clear();
+    void update(const Map& map, float timeStep, float gravity);
+    void update(const Map& map, float timeStep, float gravity, ThreadPool& pool);
+    inline int size() const { return _x.size(); }
+    inline glm::vec3 getPosition(int e) const { return {_x[e], _y[e], _z[e]}; }
+    inline glm::vec3 getVelocity(int e) const { return {_vx[e], _vy[e], _vz[e]}; }
+    //Horizontal velocity is kept against walls, vertical velocity is reset on landing or hitting a ceiling
+    inline void setVelocity(int e, glm::vec3 velocity) { _vx[e] = velocity.x; _vy[e] = velocity.y; _vz[e] = velocity.z; }
+    inline glm::vec3 getSize(int e) const { return {_sizeX[e], _sizeY[e], _sizeZ[e]}; }
+    inline uint8_t getFlags(int e) const { return _flags[e]; }
+private:
+    void collideBatch(const Map& map, float timeStep, float gravity, int batch);
+    std::vector<float> _x, _y, _z;
+    std::vector<float> _vx, _vy, _vz;
+    std::vector<float> _ay;
+    std::vector<float> _sizeX, _sizeY, _sizeZ;
+    std::vector<uint8_t> _flags;
+    //Height each entity rises this tick, before collision
+    std::vector<float> _rise;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+class ThreadPool;
+
+//Parameters for hydraulic erosion, amounts are in blocks & per iteration
+struct ErosionParams {
+    int iterations = 64;
+    float heightScale = 48;   //blocks per heightmap unit, as TerrainParams::maxY
+    float rain = 0.02;        //water added to every cell
+    float capacity = 4.0;     //sediment carried per unit of water flow & slope
+    float erosion = 0.3;      //fraction of spare capacity picked up
+    float deposition = 0.3;   //fraction of excess sediment dropped
+    float evaporation = 0.05; //fraction of water lost
+    float minSlope = 0.05;    //keeps water on flat ground carrying some sediment
+};
+
+/*Grid based hydraulic erosion of a width*depth heightmap in place, run between
+generating heights & filling the map. Each iteration rain falls on every cell,
+water flows to lower neighbours in proportion to the height difference, picks up
+sediment where it flows fast & steeply & drops it where it slows, then sediment
+moves with the water. Remaining sediment is deposited at the end.
+
+Work is split into square tiles, each with a halo of the cells the tile's next
+few iterations depend on. A tile runs those iterations on its own copy then
+writes back only its interior, so tiles never wait on each other within a round
+& halos are exchanged through the shared map between rounds. Cells are updated
+from the previous state only, so output is the same for any number of threads.
+Rows are updated with AVX2 when getSimdIsa() allows, with the same operations
+in the same order as the scalar path, so output doesn't depend on it either.
+*/
+void erodeHeightmap(float *heightmap, int width, int depth, const ErosionParams& params);
+void erodeHeightmap(float *heightmap, int width, int depth, const ErosionParams& params, ThreadPool& pool);
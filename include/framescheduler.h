@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+
+#include "stats.h"
+
+//Frame pacing strategies
+enum FramePacing {
+    VSync,      //Block in swap buffers, swap interval of 1
+    Hybrid,     //Sleep until just before the deadline, then spin the remainder
+    Uncapped    //No frame cap, swap interval of 0
+};
+
+//Order of work within a frame
+enum FramePipeline {
+    Classic,    //Swap, draw the previous frame's state, then poll input
+    LowLatency  //Poll input, draw with the newest state, then swap
+};
+
+//Frame time statistics in seconds, jitter is the standard deviation of frame time
+struct FrameStats {
+    unsigned long frames;
+    double meanFrameTime;
+    double jitter;
+    double maxDeviation;
+};
+
+/*Caps the frame rate without busy-waiting for the whole frame. In hybrid mode
+the thread sleeps until a wake-up margin before the deadline and only spins for
+the remainder. The margin is calibrated from the measured oversleep of each
+sleep, so it adapts to the resolution of the OS timer.
+*/
+class FrameScheduler {
+public:
+    FrameScheduler(FramePacing mode, double targetFps);
+    void setMode(FramePacing mode);
+    void beginFrame();
+    void endFrame();
+    void resetStats();
+    inline FramePacing getMode() const { return _mode; }
+    inline double getWakeMargin() const { return _wakeMargin; }
+    FrameStats getStats() const;
+private:
+    typedef std::chrono::steady_clock Clock;
+    FramePacing _mode;
+    double _period;
+    double _wakeMargin;
+    bool _started;
+    Clock::time_point _frameStart;
+    RunningStats _frameTimes;
+    double _maxDeviation;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include "glm/glm.hpp"
+
+//View frustum as 6 planes (xyz normal, w distance), normals point inwards
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+//Extract frustum planes from a combined projection * view matrix (Gribb & Hartmann)
+inline Frustum frustumFromMatrix(const glm::mat4& m)
+{
+    Frustum f;
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    f.planes[0] = row[3] + row[0]; //left
+    f.planes[1] = row[3] - row[0]; //right
+    f.planes[2] = row[3] + row[1]; //bottom
+    f.planes[3] = row[3] - row[1]; //top
+    f.planes[4] = row[3] + row[2]; //near
+    f.planes[5] = row[3] - row[2]; //far
+    return f;
+}
+
+//Conservative box test, false only if the box is entirely outside one plane
+inline bool aabbInFrustum(const Frustum& f, glm::vec3 min, glm::vec3 max)
+{
+    for (int i = 0; i < 6; i++) {
+        const glm::vec4& p = f.planes[i];
+        //Corner furthest along plane normal
+        glm::vec3 v = {p.x >= 0 ? max.x : min.x, p.y >= 0 ? max.y : min.y, p.z >= 0 ? max.z : min.z};
+        if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0) return false;
+    }
+    return true;
+}
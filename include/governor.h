@@ -0,0 +1,44 @@
+#pragma once
+
+//Settings the governor trades off against frame time
+struct QualitySettings {
+    float farPlane;     //draw distance
+    float lodDistance;  //chunks beyond this are drawn TopsOnly
+    int meshBudget;     //chunks remeshed per simulation tick
+    int uploadBudget;   //chunk meshes uploaded per frame
+};
+
+//Structure for initialising the governor, quality is interpolated between low & high
+struct GovernorInitData {
+    double targetFrameTime = 1.0 / 60.0;
+    int levels = 8;
+    QualitySettings low = {64.0f, 24.0f, 2, 2};
+    QualitySettings high = {200.0f, 96.0f, 16, 16};
+    float smoothing = 0.1f;     //weight of each new sample in the frame time average
+    float upperBand = 0.10f;    //fraction above target before quality is lowered
+    float lowerBand = 0.25f;    //fraction below target before quality is raised
+    int lowerAfter = 10;        //consecutive slow frames before lowering
+    int raiseAfter = 120;       //consecutive fast frames before raising
+    int cooldown = 30;          //frames after a change before another is considered
+};
+
+/*Holds CPU frame time near a target by stepping through quality levels. The
+dead band between upperBand & lowerBand, the longer dwell before raising than
+lowering, and the cooldown after a change keep quality from oscillating. Every
+change is logged with its reason.
+*/
+class QualityGovernor {
+public:
+    QualityGovernor(GovernorInitData g);
+    //Feed one frame's CPU time in seconds, returns true if settings changed
+    bool update(double frameTime);
+    QualitySettings getSettings() const;
+    inline int getLevel() const { return _level; }
+    inline double getAverageFrameTime() const { return _average; }
+private:
+    void changeLevel(int level, const char *reason);
+    GovernorInitData _initData;
+    int _level;
+    double _average;
+    int _slowFrames, _fastFrames, _cooldown;
+};
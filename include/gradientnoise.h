@@ -1,92 +1,88 @@
 #pragma once
 #include <math.h>
+#include <stdint.h>
+#include "simd.h"
 #define PI 3.14159265358979
 
+class ThreadPool;
+
+//Lattices seeded noise can be generated on
+enum NoiseLattice {
+    Square,  //gradient noise, as gradientNoise
+    Simplex  //2D simplex noise
+};
+
 //5th order smoothstep
-float smoothstep(float x) {
-    return ((6.0 * x - 15.0) * x + 10) * x * x * x;
-}
+float smoothstep(float x);
 
-/*Generate square of interpolated gradients at angles given in sinCosA and 
-normalised by norm. Sine and cosine of angles and normalisation term are 
-predetermined for the sake of efficiency, due to cost of sin, cos and sqrt 
+/*Generate square of interpolated gradients at angles given in sinCosA and
+normalised by norm. Sine and cosine of angles and normalisation term are
+predetermined for the sake of efficiency, due to cost of sin, cos and sqrt
 operations.
 */
-float gSqPixel(int x, int y, int size, float sinCosA[8], float norm) {
-	float v[4] = {};
-	for (int k = 0; k < 4; k++) {
-		int cx = x - (k % 2) * size;
-		int cy = y - (k < 2) * size;
-		cx = cx < 0 ? -cx : cx;
-		cy = cy < 0 ? -cy : cy;
-		v[k] = (cx * sinCosA[k+4] + cy * sinCosA[k]) / norm;
-	}
-	float top = v[0] + (v[1] - v[0]) * smoothstep((float)x/size);
-	float bottom = v[2] + (v[3] - v[2]) * smoothstep((float)x/size);
-	return top + (bottom - top) * smoothstep((float)y/size);
-}
+float gSqPixel(int x, int y, int size, float sinCosA[8], float norm);
 
 /*Gradient noise function, outputs array of size csize*n*csize*n clipped in
 2D space to dimensions (outXDim, outYDim). Ranges between 0 and 1*/
-void gradientNoise(float *out, int csize, int n, int outXDim, int outYDim) {
-	int nangles = n*n + 2*n+1; //grid of gradients is size (n+1)^2
-	float *sinA = new float[nangles];
-	float *cosA = new float[nangles];
-    float norm = 2.0 * (float)csize / sqrt(2); //normalisation term
-
-	for (int i = 0; i < nangles; i++) {
-		float angle = PI * (float)(rand() % 200) / 100;
-		sinA[i] = sin(angle);
-		cosA[i] = cos(angle); //fill up grid of gradient angles
-	}
+void gradientNoise(float *out, int csize, int n, int outXDim, int outYDim);
 
-	int imSize = csize*n*csize*n;
-	int pos = 0; //position in unclipped image
-	int outPos = 0; //position in output array
-	while (pos < imSize) {
-		int x = pos % (csize * n);
-		int y = pos / (csize * n); //convert 1D position to 2D
-		if (y >= outYDim)
-			break; //exit if past specified y bounds
-		if (x >= outXDim) {
-			pos += csize * n - outXDim; //skip to next line if past specified x bounds
-			continue;
-		}
-		int gridX = x / csize;
-		int gridY = y / csize; //angle grid coords
-		//get angles for 4 corners of current grid coord
-		float angles[8] = {};
-		for (int j = 0; j < 4; j++) {
-			angles[j] = sinA[(gridY + j / 2) * n + (gridX + j % 2)];
-			angles[j+4] = cosA[(gridY + j / 2) * n + (gridX + j % 2)];
-		}
-		out[outPos] = (gSqPixel(x % csize, y % csize, csize, angles, norm) + 1) / 2;
-		pos++;
-		outPos++;
-	}
-	delete[] sinA;
-	delete[] cosA;
-}
+/*How fractalNoise evaluates its octaves. Multiresolution samples each octave up
+to 8 times per cell, at least 3 pixels apart, & upsamples it with polynomials
+fitted within each cell, as the noise is smooth within a cell but not across its
+edges. Octaves with cells under 6 pixels, or that upsampling wouldn't make
+cheaper, are still evaluated at every pixel, & all octaves are summed in float.
+Output differs from FullResolution by up to about 0.01, see --noise-bench.
+*/
+enum OctaveSampling {
+    FullResolution,
+    Multiresolution
+};
 
 /*Fractal noise using above gradient noise. Octaves determines # of layers, lacunarity
 determines the rate at which cell size reduces per octave, and persistence determines
 the influence of each successive octave of noise.
 */
-void fractalNoise(float *out, int csize, int n, int octaves, float lacunarity, float persistence) {
-	gradientNoise(out, csize, n, csize*n, csize*n); //initial noise layer
-	float *octave = new float[csize*n*csize*n]; //noise layer container
-    float norm = 1;
-	for (int i = 0; i < octaves - 1; i++) {
-		int newCellSize = (int)round((float)csize / pow(lacunarity, (i + 1)));
-        int newN = (csize * n) / newCellSize + 1;
-		gradientNoise(octave, newCellSize, newN, csize*n, csize*n);
-        norm += pow(persistence, i + 1);
-		for (int j = 0; j < csize*n*csize*n; j++) {
-			out[j] += octave[j] * pow(persistence, i + 1);
-		}
-	}
-    for (int j = 0; j < csize*n*csize*n; j++) {
-        out[j] /= norm;
-    }
-	delete[] octave;
-}
\ No newline at end of file
+void fractalNoise(float *out, int csize, int n, int octaves, float lacunarity, float persistence,
+    OctaveSampling sampling = OctaveSampling::FullResolution);
+//As above, with tiles of rows generated on the pool's threads. Output doesn't depend on the thread count.
+void fractalNoise(float *out, int csize, int n, int octaves, float lacunarity, float persistence, ThreadPool& pool,
+    OctaveSampling sampling = OctaveSampling::FullResolution);
+
+/*Seeded noise over any window of an unbounded plane. Gradients come from a hash of
+the seed & lattice point rather than rand(), so any window (x0, z0, width, height)
+can be generated on its own, on any thread, & matches its neighbours exactly
+along shared borders. Output is width*height, row by row along x, ranging between
+0 and 1. Windows may start at negative coordinates.
+*/
+void seededNoise(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed);
+/*Simplex noise with the same interface. Each sample sums 3 corners of a triangular
+lattice with a radial falloff, so features aren't aligned to the axes & values
+spread more evenly between 0 and 1. The lattice is spaced so csize gives
+features the size of seededNoise's, as measured by correlation over distance.
+Not vectorised.*/
+void simplexNoise(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed);
+//Fractal version, octaves as fractalNoise. Each octave uses its own seed derived from seed.
+void seededFractalNoise(float *out, int x0, int z0, int width, int height, int csize, int octaves,
+    float lacunarity, float persistence, uint32_t seed, NoiseLattice lattice = NoiseLattice::Square);
+//Hash of a seed & lattice point used for gradients
+uint32_t latticeHash(uint32_t seed, int x, int z);
+uint32_t latticeHash(uint32_t seed, int x, int y, int z);
+
+/*3D seeded gradient noise over a box at (x0, y0, z0), width along x, height along
+y & depth along z, any box matching its neighbours as seededNoise does. Output is
+laid out as the map: x fastest, then z, then y. Values are guaranteed to lie in
+[0, 1], not just expected to, so callers can rely on the bounds to skip work.
+*/
+void seededNoise3D(float *out, int x0, int y0, int z0, int width, int height, int depth, int csize, uint32_t seed);
+//Fractal version, octaves as fractalNoise, also guaranteed to lie in [0, 1]
+void seededFractalNoise3D(float *out, int x0, int y0, int z0, int width, int height, int depth, int csize,
+    int octaves, float lacunarity, float persistence, uint32_t seed);
+
+/*The vectorised kernels hoist each cell's corner gradients & the fade curves out
+of the pixel loop & process whole rows, using the instruction set bound by
+setSimdIsa. They perform the same float operations in the same order as gSqPixel,
+so output is bit-identical to the scalar path. This relies on gradientnoise.cpp
+being built with FMA contraction off (set in CMakeLists.txt), as fused
+multiply-adds round differently.
+*/
+void bindNoiseKernels(SimdIsa isa);
@@ -0,0 +1,73 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+//Width & depth of a tile of the mip pyramid
+#define HEIGHTFIELD_TILE 128
+//Default memory mip tiles may take, least recently used tiles are dropped beyond it
+#define HEIGHTFIELD_CACHE_BYTES (256u << 20)
+
+//Sample types of raw heightfields
+enum HeightfieldFormat {
+    UInt16,  //unsigned 16 bit integers
+    Float32  //32 bit floats
+};
+
+/*Raw heightfield raster memory-mapped from a file, for terrain rasters larger
+than memory. The file holds width*depth little endian samples row by row along
+x with no header, as exported by GIS tools. Only the pages of samples read are
+brought into memory, & the OS can drop them again.
+
+Coarser mip levels halve each dimension, averaging 2x2 samples of the level
+below. They're built lazily in square tiles, each from the tiles of the level
+below it covers, & kept within a memory budget, so only the parts of the
+pyramid read are ever built. Tiles dropped from the budget are rebuilt
+identically when read again.
+*/
+class Heightfield {
+public:
+    Heightfield(size_t cacheBytes = HEIGHTFIELD_CACHE_BYTES);
+    ~Heightfield();
+    Heightfield(const Heightfield&) = delete;
+    Heightfield& operator=(const Heightfield&) = delete;
+    //Maps the file, false if it can't be opened or holds fewer than width*depth samples
+    bool open(const char *path, int width, int depth, HeightfieldFormat format);
+    void close();
+    /*Samples at low & high become heights 0 & 1, as fromHeightmap expects.
+    Defaults to the full range of 16 bit samples, & to 0 & 1 for floats.*/
+    void setRange(float low, float high);
+    /*Window of a mip level, width*depth heights row by row along x. Samples
+    outside the level repeat its edge. Safe to call from several threads.*/
+    void read(float *out, int x0, int z0, int width, int depth, int level = 0) const;
+    //Levels down to a single sample, 0 if no file is open
+    int getLevels() const;
+    inline int getWidth(int level = 0) const { return _width ? ((_width - 1) >> level) + 1 : 0; }
+    inline int getDepth(int level = 0) const { return _depth ? ((_depth - 1) >> level) + 1 : 0; }
+    inline bool isOpen() const { return _data != NULL; }
+private:
+    struct CachedTile {
+        std::shared_ptr<const float> heights;
+        std::list<uint64_t>::iterator use;
+    };
+    //Level 0, straight from the mapping
+    void readRaster(float *out, int x0, int z0, int width, int depth) const;
+    std::shared_ptr<const float> getTile(int level, int tileX, int tileZ) const;
+    std::shared_ptr<const float> buildTile(int level, int tileX, int tileZ) const;
+    const unsigned char *_data;
+    size_t _size;
+    int _width, _depth;
+    HeightfieldFormat _format;
+    float _low, _high;
+#ifdef _WIN32
+    void *_file, *_mapping;
+#endif
+    //Mip tiles by level & position, most recently used at the front of the list
+    size_t _cacheTiles;
+    mutable std::unordered_map<uint64_t, CachedTile> _tiles;
+    mutable std::list<uint64_t> _uses;
+    mutable std::mutex _mutex;
+};
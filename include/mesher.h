@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "base.h"
+
+//Per-instance data for a single block face
+struct SquareData {
+    float pos[3];
+    int type;
+    int side;
+};
+
+//Side index of upward facing squares
+#define TOP_SIDE 2
+
+//Levels of detail a chunk can be drawn at
+enum ChunkLod {
+    Full,       //Every visible face
+    TopsOnly    //Only upward facing squares, for distant chunks
+};
+
+//Chunk selected for drawing & the detail to draw it at
+struct VisibleChunk {
+    int chunk;
+    ChunkLod lod;
+};
+
+/*Append a square for each visible face of the blocks in chunk (chunkX, chunkZ).
+Upward facing squares come first so the TopsOnly level of detail is a prefix of
+the chunk's instances. Returns the number of upward facing squares.
+*/
+int meshChunk(const Map& map, int chunkX, int chunkZ, std::vector<SquareData>& out);
@@ -0,0 +1,10 @@
+#pragma once
+
+/*Compares the noise generators: time per megapixel for each lattice & instruction
+set, then statistics of each output, so lattices can be compared for artifacts as
+well as speed. Prints a histogram of values, mean & standard deviation, and for
+4 directions (0, 45, 90 & 135 degrees) the RMS of the slope & the correlation
+between samples a fixed distance apart. A lattice without directional artifacts
+has similar figures in every direction.
+*/
+int runNoiseBenchmark();
@@ -0,0 +1,10 @@
+#pragma once
+
+/*Times entity physics on terrain generated as the engine does: ms per tick for
+several entity counts on one thread & on every thread, against the budget of a
+60 ticks per second simulation. Entities fall onto the terrain first, then walk
+into slopes & walls while timed, so ground detection & sliding are exercised.
+Then times raycasts in random directions through the same terrain, one at a
+time & batched, with & without SIMD packets.
+*/
+int runPhysicsBenchmark();
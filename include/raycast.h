@@ -0,0 +1,35 @@
+#pragma once
+#include "glm/glm.hpp"
+
+class Map;
+class ThreadPool;
+
+//Rays traversed together by raycastBatch
+#define RAY_PACKET 8
+//Rays per pool task in raycastBatch
+#define RAY_TASK 1024
+//Smallest empty cells of the map's occupancy pyramid raycasts skip whole, 2^level blocks a side
+#define MIN_SKIP_LEVEL 3
+
+//First solid block along a ray
+struct RayHit {
+    glm::ivec3 block;
+    glm::ivec3 normal;  //outward normal of the face entered through, zero if the ray starts in the block
+    int side;           //face entered through as SquareData::side, -1 if the ray starts in the block
+    float distance;     //along the ray to where it enters the block, INFINITY if nothing was hit
+};
+
+/*First solid block along a ray from origin, within maxDistance, by stepping
+through every block the ray crosses in order (Amanatides & Woo). direction
+needn't be normalised, distances are in blocks. Rays are clipped to the map
+first, so they may start outside it.*/
+bool raycast(const Map& map, glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit);
+/*raycast for count rays, giving the same hits. With AVX2 rays are traversed in
+packets of RAY_PACKET, one per SIMD lane, each lane stepping its own ray &
+gathering the blocks it's in. Lanes whose rays are done are given the next rays,
+so incoherent rays of different lengths keep the packet busy. Misses have
+distance INFINITY.*/
+void raycastBatch(const Map& map, const glm::vec3 *origins, const glm::vec3 *directions, int count,
+    float maxDistance, RayHit *hits);
+void raycastBatch(const Map& map, const glm::vec3 *origins, const glm::vec3 *directions, int count,
+    float maxDistance, RayHit *hits, ThreadPool& pool);
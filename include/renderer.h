@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "glm/glm.hpp"
+
+#include "mesher.h"
+#include "commandbuffer.h"
+#include "threadpool.h"
+#include "uploadworker.h"
+
+//Binding point of the per-frame camera uniform block
+#define CAMERA_UBO_BINDING 0
+
+//GL objects for a single chunk's faces, version of the mesh they hold
+struct ChunkMesh {
+    unsigned int vao, ibo;
+    unsigned int count, topCount;
+    unsigned long version;
+    glm::vec3 min, max; //bounds of the chunk's blocks
+};
+
+//Chunk mesh waiting for upload
+struct PendingUpload {
+    int chunk;
+    unsigned long version;
+    int topCount;
+    std::shared_ptr<const std::vector<SquareData>> instances;
+};
+
+//Per-frame camera data, laid out to match the std140 Camera block in shaders.h
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+/*Owns the GL objects used to draw the map and issues all draw calls. Draws are
+recorded as packets off the GL thread and submitted in sort key order. Bound
+program, vertex array and texture are tracked so redundant binds are dropped,
+and uniform locations are looked up once at construction. Every GL call made
+by the renderer is counted, so the per-frame call count can be inspected.
+*/
+class Renderer {
+public:
+    Renderer(int width, int height);
+    ~Renderer();
+    void setProjection(const glm::mat4& projection);
+    //Transfers go through the worker's shared context when set, else are made on the render thread
+    inline void setUploadWorker(UploadWorker *uploader) { _uploader = uploader; }
+    void uploadChunk(int chunk, unsigned long version, int topCount, const std::vector<SquareData>& instances);
+    //Queue a mesh for upload, replacing any older queued version of the same chunk
+    void queueChunk(const PendingUpload& upload);
+    void queueTexture(std::shared_ptr<const unsigned char> pixels, int width, int height);
+    /*Upload queued meshes in the order they were queued, at most the upload budget
+    per frame, or with a worker at most the budget in flight. Finished transfers
+    are only used once their fence has signalled.*/
+    void processUploads();
+    inline void setUploadBudget(int budget) { _uploadBudget = budget; }
+    inline size_t getQueuedUploads() const { return _uploadQueue.size(); }
+    inline int getUploadsInFlight() const { return _uploadsInFlight; }
+    void uploadTexture(const unsigned char *data, int width, int height);
+    /*Cull chunks against the final view & record a packet for each on the pool's
+    threads. Only reads renderer state, so may run while no uploads are made.*/
+    void recordChunks(ThreadPool& pool, const glm::mat4& view, const std::vector<VisibleChunk>& chunks,
+        CommandBuffer& commands) const;
+    //Merge & sort recorded packets, then submit them
+    void drawFrame(const glm::mat4& view, CommandBuffer& commands);
+    inline unsigned int getFrameCalls() const { return _frameCalls; }
+    //Chunks drawn by the last frame
+    inline unsigned int getFrameDraws() const { return _frameDraws; }
+    inline unsigned long long getTotalCalls() const { return _totalCalls; }
+private:
+    void useProgram(unsigned int program);
+    void bindVertexArray(unsigned int vao);
+    void bindTexture(unsigned int texture);
+    void attachInstances(ChunkMesh& mesh, unsigned int ibo);
+    void finishUpload(const UploadResult& result);
+    inline void countCall(unsigned int n = 1) { _callCounter += n; }
+    unsigned int _program, _squareVBO, _cameraUBO, _texture;
+    unsigned int _boundProgram, _boundVAO, _boundTexture;
+    int _samplerLoc;
+    std::vector<ChunkMesh> _chunks;
+    std::vector<PendingUpload> _uploadQueue;
+    UploadWorker *_uploader;
+    std::vector<UploadResult> _completedUploads;
+    int _uploadsInFlight;
+    int _uploadBudget;
+    unsigned int _callCounter, _frameCalls, _frameDraws;
+    unsigned long long _totalCalls;
+    CameraBlock _cameraData;
+};
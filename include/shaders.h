@@ -8,15 +8,26 @@ layout (location = 2) in vec3 offs;
 layout (location = 3) in int txPos;
 layout (location = 4) in int side;
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 rotations[6];
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+//Rotation of the base square for each face of the cube
+const mat3 rotations[6] = mat3[6](
+    mat3(1.0),
+    mat3(0.0, 1.0, 0.0,     -1.0, 0.0, 0.0,     0.0, 0.0, 1.0),
+    mat3(0.0, -1.0, 0.0,    1.0, 0.0, 0.0,      0.0, 0.0, 1.0),
+    mat3(-1.0, 0.0, 0.0,    0.0, 1.0, 0.0,      0.0, 0.0, -1.0),
+    mat3(0.0, 0.0, -1.0,    0.0, 1.0, 0.0,      1.0, 0.0, 0.0),
+    mat3(0.0, 0.0, 1.0,     0.0, 1.0, 0.0,      -1.0, 0.0, 0.0)
+);
 
 out vec2 fTexCoord;
 
 void main()
 {
-    vec4 newPos = rotations[side] * vec4(pos, 1.0) + vec4(offs+0.5, 0.0);
+    vec4 newPos = vec4(rotations[side] * pos + offs + 0.5, 1.0);
     gl_Position = projection * view * newPos;
     float txOffs = side == 2 ? 0.0 : side == 1 ? 0.25 : 0.5;
     fTexCoord = vec2(txOffs + texCoord.x * 0.25, float(txPos) * 0.25 + texCoord.y*0.25);
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include "frustum.h"
+
+//Instruction sets kernels can be run with, each a superset of the ones before
+enum SimdIsa {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+/*Hot kernels, bound once to the widest instruction set the CPU supports. Each
+variant is written with target attributes in the kernel's own file, so one
+binary runs on any x86-64 CPU, & gives the same output as the scalar variant.
+Kernels with no gain from wider registers bind the widest variant that helps.
+*/
+struct SimdKernels {
+    /*Visible faces of count blocks along x: bit j of masks[i] is set if block i
+    is solid & its neighbour on side j (as Map::surroundingBlocks) isn't. row holds
+    count + 2 blocks, the neighbours before & after the run at either end. back,
+    front, above & below are the neighbouring rows, count blocks each.*/
+    void (*faceMasks)(const bool *row, const bool *back, const bool *front, const bool *above, const bool *below,
+        int count, uint8_t *masks);
+    /*aabbInFrustum for count boxes, given as arrays of each coordinate of their
+    corners, so several boxes are tested per plane at once.*/
+    void (*boxesInFrustum)(const Frustum& f, const float *minX, const float *minY, const float *minZ,
+        const float *maxX, const float *maxY, const float *maxZ, int count, bool *inside);
+    //Whether any of count blocks is solid
+    bool (*anySolid)(const bool *blocks, int count);
+    /*Velocity Verlet step of count bodies' vertical motion, as Player::applyGravity.
+    Bodies accelerate down at gravity unless bit 0 of their flags (Grounded) is
+    set. Writes the height each moves by to rise, advancing velocity & acceleration.*/
+    void (*verletStep)(float *velocity, float *acceleration, const uint8_t *flags, float gravity, float timeStep,
+        int count, float *rise);
+};
+
+//Widest instruction set the CPU & OS support, detected on first use
+SimdIsa detectSimdIsa();
+/*Bind every kernel, including the noise kernels, for isa, capped at what's
+detected. Forcing a narrower set is for benchmarking & testing, as output
+doesn't change. Not safe while kernels run on other threads.*/
+void setSimdIsa(SimdIsa isa);
+SimdIsa getSimdIsa();
+const SimdKernels& simdKernels();
+//Names as accepted by --isa: scalar, sse4.1, avx2 & avx512
+const char *simdIsaName(SimdIsa isa);
+bool parseSimdIsa(const char *name, SimdIsa& isa);
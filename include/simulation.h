@@ -0,0 +1,108 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "base.h"
+#include "mesher.h"
+#include "concurrent.h"
+
+#define INPUT_QUEUE_SIZE 256
+
+enum InputEventType {
+    KeyEvent,
+    CursorEvent
+};
+
+//Input from GLFW callbacks, timestamped with steadySeconds()
+struct InputEvent {
+    InputEventType type;
+    PlayerMovement direction;
+    bool pressed;
+    double x, y;
+    double timestamp;
+};
+
+//New instance data for a chunk, shared immutably between simulation & render threads
+struct ChunkMeshUpdate {
+    int chunk;
+    unsigned long version;
+    int topCount; //leading instances drawn at TopsOnly detail
+    unsigned long tick; //tick at which the mesh was built
+    std::shared_ptr<const std::vector<SquareData>> instances;
+};
+
+/*State published by the simulation thread once per tick. Mesh updates stay in
+every snapshot until the render thread acknowledges a tick at or after the one
+they were built at, so none are lost when the renderer skips snapshots.
+*/
+struct FrameSnapshot {
+    unsigned long tick;
+    double tickTime;
+    glm::mat4 camera;
+    glm::vec3 prevPosition, position;
+    float yaw, pitch;
+    //Cursor position yaw & pitch were derived from, for late latching
+    bool cursorValid;
+    double cursorX, cursorY;
+    //Timestamp of the newest input event applied up to this tick
+    double latestInputTime;
+    //Every chunk has been meshed at least once
+    bool meshed;
+    std::vector<VisibleChunk> visibleChunks;
+    std::vector<ChunkMeshUpdate> dirtyMeshes;
+};
+
+//Monotonic time in seconds, shared clock for both threads
+double steadySeconds();
+
+/*Runs the engine on its own thread at the engine's tick rate. Input is fed in
+through a lock-free queue and results come out as snapshots through a triple
+buffer, so neither the simulation nor the render thread waits on the other.
+The engine must not be touched by any other thread between start() and stop().
+*/
+class Simulation {
+public:
+    Simulation(Engine& engine, const glm::mat4& projection);
+    ~Simulation();
+    void start();
+    void stop();
+    bool pushInput(const InputEvent& event);
+    //Latest published snapshot, or NULL if there hasn't been one yet. Valid until the next call.
+    const FrameSnapshot* latestSnapshot();
+    void acknowledge(unsigned long tick);
+    //Quality settings, may be changed from any thread while running
+    void setQuality(float farPlane, float lodDistance, int meshBudget);
+    glm::mat4 renderCamera(const FrameSnapshot& snapshot, double now) const;
+    //As renderCamera, but with rotation taken from a cursor position sampled after the snapshot
+    glm::mat4 lateLatchedCamera(const FrameSnapshot& snapshot, double now, double cursorX, double cursorY) const;
+private:
+    void run();
+    void drainInput();
+    void remeshBacklog();
+    void publish(double now);
+    Engine& _engine;
+    glm::mat4 _projection;
+    double _tickStep;
+    float _mouseSensitivity;
+    double _latestInputTime;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<unsigned long> _ackedTick;
+    std::atomic<float> _farPlane, _lodDistance;
+    std::atomic<int> _meshBudget;
+    SPSCQueue<InputEvent, INPUT_QUEUE_SIZE> _input;
+    TripleBuffer<FrameSnapshot> _snapshots;
+    std::vector<unsigned long> _meshVersions;
+    std::vector<ChunkMeshUpdate> _pendingMeshes;
+    //Chunks waiting to be remeshed, nearest first, at most _meshBudget per tick
+    std::vector<int> _meshBacklog;
+    std::vector<int> _dirtyChunks;
+    std::vector<size_t> _faceCounts;
+    //Culling bounds of every chunk, each coordinate of the corners in turn, for simdKernels().boxesInFrustum
+    std::vector<float> _chunkBounds;
+    std::unique_ptr<bool[]> _chunkInFrustum;
+    bool _initialMeshDone;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+
+/*Startup work as a dependency graph. Each task runs once all of its
+dependencies have succeeded, on the pool's workers or, for work that needs the
+main thread (window & GL context creation), on the thread calling run(). A
+failed task skips everything depending on it. Task timings are measured from
+the graph's construction, so they show how much of startup overlapped.
+*/
+class StartupGraph {
+public:
+    StartupGraph();
+    //Returns the task's id, dependencies must already have been added
+    int add(const std::string& name, std::function<bool()> fn, const std::vector<int>& dependencies = {},
+        bool mainThread = false);
+    //Run every task, returns false if any failed or was skipped
+    bool run(ThreadPool& pool);
+    //Print each task's start & end time
+    void report() const;
+    inline double getOrigin() const { return _origin; }
+private:
+    enum TaskState {
+        Waiting,
+        Succeeded,
+        Failed,
+        Skipped
+    };
+    struct Task {
+        std::string name;
+        std::function<bool()> fn;
+        std::vector<int> dependents;
+        bool mainThread;
+        int unfinished; //dependencies yet to succeed
+        TaskState state;
+        double start, end;
+    };
+    void launch(int task, ThreadPool& pool);
+    void execute(int task, ThreadPool& pool);
+    void skip(int task);
+    std::vector<Task> _tasks;
+    double _origin;
+    //Shared between the workers & main thread during run()
+    std::vector<int> _mainReady;
+    int _finished;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+};
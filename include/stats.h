@@ -0,0 +1,20 @@
+#pragma once
+#include <math.h>
+
+//Running mean, standard deviation & maximum of a series (Welford's algorithm)
+struct RunningStats {
+    unsigned long count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double max = 0.0;
+
+    inline void add(double x) {
+        count++;
+        double delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+        if (count == 1 || x > max) max = x;
+    }
+    inline double stddev() const { return count > 1 ? sqrt(m2 / (count - 1)) : 0.0; }
+    inline void reset() { *this = RunningStats(); }
+};
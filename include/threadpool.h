@@ -0,0 +1,34 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+/*Fixed set of worker threads. parallelFor splits work into tasks which the
+workers and the calling thread pull from a shared counter, so it never waits
+on a busy pool: the caller finishes the remaining tasks itself. Worker index 0
+is always the calling thread, workers are 1 to getThreadCount() - 1, so only one
+parallelFor may run at a time. It may be called from inside a job, whose thread
+then takes index 0 for the duration.
+*/
+class ThreadPool {
+public:
+    //0 threads uses one per hardware thread, minus the caller
+    ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+    //Run fn(task, worker) for every task in [0, tasks), returns once all are done
+    void parallelFor(int tasks, const std::function<void(int, int)>& fn);
+    //Queue a job to run on a worker thread
+    void submit(std::function<void(int)> job);
+    //Workers plus the calling thread
+    inline unsigned int getThreadCount() const { return _workers.size() + 1; }
+private:
+    void workerLoop(int worker);
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void(int)>> _jobs;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stopping;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "mesher.h"
+#include "concurrent.h"
+
+#define UPLOAD_QUEUE_SIZE 512
+
+enum UploadType {
+    ChunkUpload,
+    TextureUpload
+};
+
+//Transfer requested by the render thread
+struct UploadJob {
+    UploadType type;
+    //Chunk uploads
+    int chunk;
+    unsigned long version;
+    int topCount;
+    std::shared_ptr<const std::vector<SquareData>> instances;
+    //Texture uploads, RGBA8
+    std::shared_ptr<const unsigned char> pixels;
+    int width, height;
+};
+
+/*Finished transfer. The object is only safe to use from the render context once
+fence has signalled, which the render thread polls without blocking.
+*/
+struct UploadResult {
+    UploadJob job;
+    unsigned int object; //buffer or texture name, shared between contexts
+    void *fence;         //GLsync
+    glm::vec3 min, max;  //bounds of a chunk's blocks
+};
+
+/*Performs buffer & texture uploads on its own thread, in a GL context sharing
+objects with the render context. Only buffers & textures are created here, as
+vertex arrays aren't shared between contexts. The context is made current
+through callbacks, so any context creation mechanism can be used: a hidden
+GLFW window in the engine, or a surfaceless EGL context under Mesa's software
+driver.
+*/
+class UploadWorker {
+public:
+    UploadWorker(std::function<void()> makeCurrent, std::function<void()> releaseCurrent);
+    ~UploadWorker();
+    void start();
+    /*Finish queued jobs & stop. A result that can't be queued any more is
+    deleted; results still queued are the render thread's to pop & delete.*/
+    void stop();
+    //Render thread side
+    bool push(const UploadJob& job);
+    bool pop(UploadResult& result);
+private:
+    void run();
+    void upload(const UploadJob& job);
+    std::function<void()> _makeCurrent, _releaseCurrent;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    SPSCQueue<UploadJob, UPLOAD_QUEUE_SIZE> _jobs;
+    SPSCQueue<UploadResult, UPLOAD_QUEUE_SIZE> _results;
+    //Wakes the worker when jobs are pushed
+    std::mutex _mutex;
+    std::condition_variable _wake;
+};
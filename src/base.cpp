@@ -1,26 +1,30 @@
 #include "base.h"
 #include <math.h>
+#include <string.h>
+#include <algorithm>
 #include "glm/gtc/matrix_transform.hpp"
 #include <iostream>
 
+#include "gradientnoise.h"
+#include "heightfield.h"
+#include "simd.h"
+
 const glm::vec3 up = {0.0f, 1.0f, 0.0f};
 
 void Engine::cursorMoved(double xpos, double ypos)
 {
     //Adapted from Learn OpenGL by Joey de Vries
-    float fXPos = static_cast<float>(xpos);
-    float fYPos = static_cast<float>(ypos);
     if (!_mouseMoved) {
         _mouseMoved = true;
-        _lastMouseX = fXPos;
-        _lastMouseY = fYPos;
+        _lastMouseX = xpos;
+        _lastMouseY = ypos;
     }
 
-    float xOffs = (xpos - _lastMouseX) * _initData.mouseSensitivity;
-    float yOffs = (_lastMouseY - ypos) * _initData.mouseSensitivity;
+    float xOffs = static_cast<float>(xpos - _lastMouseX) * _initData.mouseSensitivity;
+    float yOffs = static_cast<float>(_lastMouseY - ypos) * _initData.mouseSensitivity;
     
-    _lastMouseX = fXPos;
-    _lastMouseY = fYPos;
+    _lastMouseX = xpos;
+    _lastMouseY = ypos;
 
     _player.incrementYaw(xOffs);
     _camPitch = glm::clamp(_camPitch + yOffs, -89.0f, 89.0f);
@@ -31,9 +35,45 @@ void Engine::setPlayerMoving(PlayerMovement direction, bool moving)
     _player.setMoving(direction, moving);
 }
 
-void Engine::update()
+float Engine::advance(double frameTime)
+{
+    //Run as many fixed ticks as the elapsed time covers, bounded so a slow frame can't spiral
+    _accumulator += frameTime;
+    int ticks = 0;
+    while (_accumulator >= _tickStep && ticks < _initData.maxTicksPerFrame) {
+        tick();
+        _accumulator -= _tickStep;
+        ticks++;
+    }
+    //Drop time that couldn't be caught up on, rather than carrying it into the next frame
+    if (_accumulator >= _tickStep) _accumulator = fmod(_accumulator, _tickStep);
+
+    //Render between the last two ticks by the fraction of a tick left over
+    float alpha = static_cast<float>(_accumulator / _tickStep);
+    updateCamera(alpha);
+    return alpha;
+}
+
+void Engine::tick()
 {
-    _player.applyGravity(1.0f / MAX_FPS);
+    _tickCount++;
+    float timeStep = static_cast<float>(_tickStep);
+    _player.savePosition();
+    /*Box swept through the map for the player, from the eyes at the player's
+    position down to just above the feet, which rest blockBaseOffset into the
+    block stood on.*/
+    glm::vec3 dimensions = _player.getDimensions();
+    glm::vec3 halfExtents = {dimensions.x / 2, 0.0f, dimensions.z / 2};
+    glm::vec3 bodyMin = -halfExtents - glm::vec3{0.0f, dimensions.y - _initData.blockBaseOffset, 0.0f};
+    glm::vec3 bodyMax = halfExtents;
+
+    //Rise or fall first, stopping at floors & ceilings
+    float rise = _player.applyGravity(timeStep);
+    glm::vec3 position = _player.getCurrentPosition();
+    glm::bvec3 blocked;
+    _player.move(_map.slideBox(position + bodyMin, position + bodyMax, {0.0f, rise, 0.0f}, &blocked));
+    if (blocked.y && rise > 0) _player.resetGravity();
+
     /*Fall detection, gets bottom corners of player's bounding box and checks whether 
     it intersects the map.*/
     glm::vec3 playerFeetPos = _player.getCurrentPosition();
@@ -47,16 +87,19 @@ void Engine::update()
     if (_player.getFalling() && !currentlyFalling) _player.setFalling(false);
     else if (!_player.getFalling() && currentlyFalling) _player.setFalling(true);
 
-    //Move player if collision not detected
-    if (!_map.cuboidIntersectsMap(_player.getNextPosition(), _player.getDimensions()))
-        _player.move();
-    
-    //Calculate view matrix from player rotation & camera pitch
-    glm::vec3 direction;
-    direction.x = cos(glm::radians(_player.getYaw())) * cos(glm::radians(_camPitch));
-    direction.y = sin(glm::radians(_camPitch));
-    direction.z = sin(glm::radians(_player.getYaw())) * cos(glm::radians(_camPitch));
-    _camera = glm::lookAt(_player.getCurrentPosition(), glm::normalize(direction) + _player.getCurrentPosition(), up);
+    //Move player as far as collision allows, sliding along walls
+    position = _player.getCurrentPosition();
+    glm::vec3 motion = _player.getNextPosition(timeStep) - position;
+    _player.move(_map.slideBox(position + bodyMin, position + bodyMax, motion));
+
+    _entities.update(_map, timeStep, _initData.gravity);
+}
+
+void Engine::updateCamera(float alpha)
+{
+    //Calculate view matrix from interpolated player position.
+    //Rotation isn't interpolated as it follows the mouse rather than the simulation.
+    _camera = cameraMatrix(_player.getInterpolatedPosition(alpha), _player.getYaw(), _camPitch);
 }
 
 void Engine::loadHeightmap(float *heightmap, float maxY)
@@ -64,26 +107,108 @@ void Engine::loadHeightmap(float *heightmap, float maxY)
     _map.fromHeightmap(heightmap, maxY);
 }
 
-void Player::move()
+int Engine::generateChunk(const TerrainParams& params, int chunkX, int chunkZ, const float *heightmap)
+{
+    float heights[CHUNK_SIZE * CHUNK_SIZE];
+    int x0 = chunkX * CHUNK_SIZE, z0 = chunkZ * CHUNK_SIZE;
+    if (heightmap) {
+        //Columns beyond the map repeat its edge, they're clipped when filling
+        int xDim = _map.getXDim(), zDim = _map.getZDim();
+        for (int z = 0; z < CHUNK_SIZE; z++)
+            for (int x = 0; x < CHUNK_SIZE; x++)
+                heights[z * CHUNK_SIZE + x] = heightmap[std::min(z0 + z, zDim - 1) * xDim + std::min(x0 + x, xDim - 1)];
+    }
+    else seededFractalNoise(heights, x0, z0, CHUNK_SIZE, CHUNK_SIZE, params.cellSize, params.octaves,
+        params.lacunarity, params.persistence, params.seed, params.lattice);
+    _map.fillColumns(x0, z0, CHUNK_SIZE, CHUNK_SIZE, heights, params.maxY);
+    if (params.densityAmplitude <= 0) return 0;
+
+    /*Density lies in [0, 1], so the surface stays within amplitude of the
+    heightmap's. Blocks are solid while y + 1 <= surface, so rows below
+    floor(lowest - amplitude) are solid & rows from floor(highest + amplitude) up
+    are air, as fillColumns left them. Only sections overlapping the rows between
+    sample 3D noise, & only over those rows.*/
+    float lowest = params.maxY, highest = 0;
+    for (float h : heights) {
+        lowest = std::min(lowest, h * params.maxY);
+        highest = std::max(highest, h * params.maxY);
+    }
+    int ySolid = std::max((int)floorf(lowest - params.densityAmplitude), 0);
+    int yAir = std::min((int)floorf(highest + params.densityAmplitude), (int)_map.getYDim());
+    int sampled = 0;
+    float density[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+    for (int section = ySolid / CHUNK_SIZE * CHUNK_SIZE; section < yAir; section += CHUNK_SIZE) {
+        int y0 = std::max(section, ySolid), height = std::min(section + CHUNK_SIZE, yAir) - y0;
+        seededFractalNoise3D(density, x0, y0, z0, CHUNK_SIZE, height, CHUNK_SIZE, params.densityCellSize,
+            params.densityOctaves, params.lacunarity, params.persistence, latticeHash(params.seed, 0, 1, 0));
+        _map.fillDensity(x0, y0, z0, CHUNK_SIZE, height, CHUNK_SIZE, heights, params.maxY, density,
+            params.densityAmplitude);
+        sampled++;
+    }
+    return sampled;
+}
+
+void Engine::loadHeightfieldChunk(const Heightfield& field, int level, int x0, int z0, float maxY, int chunkX,
+    int chunkZ)
+{
+    float heights[CHUNK_SIZE * CHUNK_SIZE];
+    int mapX = chunkX * CHUNK_SIZE, mapZ = chunkZ * CHUNK_SIZE;
+    field.read(heights, x0 + mapX, z0 + mapZ, CHUNK_SIZE, CHUNK_SIZE, level);
+    _map.fillColumns(mapX, mapZ, CHUNK_SIZE, CHUNK_SIZE, heights, maxY);
+}
+
+void Engine::setBlock(int x, int y, int z, bool value)
+{
+    _map.setAt(x, y, z, value);
+    //Mark owning chunk dirty, along with neighbours whose faces border this block
+    int offsets[5][2] = {{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (int i = 0; i < 5; i++) {
+        int nx = x + offsets[i][0], nz = z + offsets[i][1];
+        if (nx < 0 || nz < 0 || nx >= (int)_map.getXDim() || nz >= (int)_map.getZDim()) continue;
+        int chunk = nx / CHUNK_SIZE + (nz / CHUNK_SIZE) * _map.getChunksX();
+        bool found = false;
+        for (int c : _dirtyChunks) found |= c == chunk;
+        if (!found) _dirtyChunks.push_back(chunk);
+    }
+}
+
+void Engine::takeDirtyChunks(std::vector<int>& out)
+{
+    out.insert(out.end(), _dirtyChunks.begin(), _dirtyChunks.end());
+    _dirtyChunks.clear();
+}
+
+glm::mat4 cameraMatrix(glm::vec3 position, float yaw, float pitch)
+{
+    //Calculate view matrix from player rotation & camera pitch
+    glm::vec3 direction;
+    direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+    direction.y = sin(glm::radians(pitch));
+    direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+    return glm::lookAt(position, glm::normalize(direction) + position, up);
+}
+
+void Player::move(glm::vec3 offset)
 {
-    _position = getNextPosition();
+    _position += offset;
 }
 
-glm::vec3 Player::getNextPosition()
+glm::vec3 Player::getNextPosition(float timeStep)
 {
     //Start with current position
     glm::vec3 newPos = _position;
     //Calculate players horizontal bearing
     glm::vec3 direction = glm::normalize(glm::vec3{cos(glm::radians(_yaw)), 0.0f, sin(glm::radians(_yaw))});
+    float distance = _speed * timeStep;
     //Increment position based on set movement flags
     if ((_movementFlags >> PlayerMovement::Forward) & 1)
-        newPos += direction * _speed;
+        newPos += direction * distance;
     if ((_movementFlags >> PlayerMovement::Backwards) & 1)
-        newPos -= direction * _speed;
+        newPos -= direction * distance;
     if ((_movementFlags >> PlayerMovement::Left) & 1)
-        newPos -= glm::normalize(glm::cross(direction, up)) * _speed;
+        newPos -= glm::normalize(glm::cross(direction, up)) * distance;
     if ((_movementFlags >> PlayerMovement::Right) & 1)
-        newPos += glm::normalize(glm::cross(direction, up)) * _speed;
+        newPos += glm::normalize(glm::cross(direction, up)) * distance;
     return newPos;
 }
 
@@ -106,7 +231,7 @@ void Player::setFalling(bool isFalling)
     }
 }
 
-void Player::applyGravity(float timeStep)
+float Player::applyGravity(float timeStep)
 {
     //Velocity verlet, adapted from Wikipedia
     float newYPos = _position.y + _yVelocity * timeStep + _yAcceleration * (timeStep * timeStep * 0.5f);
@@ -116,9 +241,9 @@ void Player::applyGravity(float timeStep)
         if (!_falling) newYAcc += _jumpForce;
     }
     float newYVel = _yVelocity + (_yAcceleration + newYAcc) * (timeStep * 0.5f);
-    _position.y = newYPos;
     _yVelocity = newYVel;
     _yAcceleration = newYAcc;
+    return newYPos - _position.y;
 }
 
 void Player::resetGravity()
@@ -135,6 +260,28 @@ void Player::incrementYaw(float amount)
     else _yaw = 360.0f + newYaw;
 }
 
+Map::Map(unsigned int xDimensions, unsigned int yDimensions, unsigned int zDimensions) :
+    _xDim(xDimensions), _yDim(yDimensions), _zDim(zDimensions),
+    _map(new bool[xDimensions*yDimensions*zDimensions + MAP_PADDING]()),
+    _heights(new int[xDimensions*zDimensions]())
+{
+    //Levels until one cell covers the map, all empty as the map is
+    unsigned int largest = std::max(std::max(_xDim, _yDim), _zDim);
+    for (int level = 1; (1u << (level - 1)) < largest; level++) {
+        glm::ivec3 dims = getOccupancyDims(level);
+        size_t cells = (size_t)dims.x * dims.y * dims.z;
+        if (level <= BYTE_LEVELS) _byteOccupancy.emplace_back(new std::atomic<uint8_t>[cells]());
+        else _occupancy.emplace_back(new std::atomic<uint32_t>[cells]());
+    }
+    glm::ivec3 sectionDims = getSectionDims();
+    size_t sections = (size_t)sectionDims.x * sectionDims.y * sectionDims.z;
+    _volumeTables.reset(new std::shared_ptr<const uint16_t[]>[sections]);
+    _sectionEdits.reset(new std::atomic<uint32_t>[sections]());
+    //No table is built yet
+    _volumesBuilt.reset(new std::atomic<uint32_t>[sections]);
+    for (size_t i = 0; i < sections; i++) _volumesBuilt[i].store(UINT32_MAX, std::memory_order_relaxed);
+}
+
 void Map::fromHeightmap(float *heightmap, float maxY)
 {
     for (int x = 0; x < _xDim; x++)
@@ -147,28 +294,437 @@ void Map::fromHeightmap(float *heightmap, float maxY)
     }
 }
 
+void Map::fillColumns(int x0, int z0, int width, int depth, const float *heights, float maxY)
+{
+    //Clip to the map, heights keep their row length
+    int stride = width;
+    int xStart = std::max(x0, 0), xEnd = std::min(x0 + width, (int)_xDim);
+    int zStart = std::max(z0, 0), zEnd = std::min(z0 + depth, (int)_zDim);
+    if (xStart >= xEnd || zStart >= zEnd) return;
+    width = xEnd - xStart;
+
+    std::vector<int> tops(width);
+    writeCounted({xStart, 0, zStart}, {xEnd, (int)_yDim, zEnd}, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            const float *row = heights + (z - z0) * stride + (xStart - x0);
+            int lowest = _yDim, highest = 0;
+            for (int x = 0; x < width; x++) {
+                tops[x] = glm::clamp((int)(row[x] * maxY), 0, (int)_yDim);
+                lowest = std::min(lowest, tops[x]);
+                highest = std::max(highest, tops[x]);
+            }
+            std::copy(tops.begin(), tops.end(), &_heights[xStart + z * _xDim]);
+            for (int y = 0; y < (int)_yDim; y++) {
+                bool *blocks = &_map[xStart + y * _xDim * _zDim + z * _xDim];
+                if (y < lowest) std::fill_n(blocks, width, true);
+                else if (y >= highest) std::fill_n(blocks, width, false);
+                else for (int x = 0; x < width; x++) blocks[x] = y < tops[x];
+            }
+        }
+    });
+}
+void Map::fillDensity(int x0, int y0, int z0, int width, int height, int depth, const float *heights, float maxY,
+        const float *density, float amplitude)
+{
+    //Clip to the map as fillColumns, heights & density keep their row lengths
+    int xStart = std::max(x0, 0), xEnd = std::min(x0 + width, (int)_xDim);
+    int yStart = std::max(y0, 0), yEnd = std::min(y0 + height, (int)_yDim);
+    int zStart = std::max(z0, 0), zEnd = std::min(z0 + depth, (int)_zDim);
+    if (xStart >= xEnd || yStart >= yEnd || zStart >= zEnd) return;
+    //Height of each column's blocks in the box, 0 if none are solid
+    std::vector<int> tops((xEnd - xStart) * (zEnd - zStart));
+    writeCounted({xStart, yStart, zStart}, {xEnd, yEnd, zEnd}, [&](int zBegin, int zEnd) {
+        for (int y = yStart; y < yEnd; y++) {
+            for (int z = zBegin; z < zEnd; z++) {
+                const float *row = heights + (z - z0) * width;
+                const float *d = density + ((y - y0) * depth + (z - z0)) * width;
+                bool *blocks = &_map[y * _xDim * _zDim + z * _xDim];
+                int *top = tops.data() + (z - zStart) * (xEnd - xStart);
+                //fillColumns' rule, y < (int)(h * maxY), is y + 1 <= h * maxY
+                for (int x = xStart; x < xEnd; x++) {
+                    blocks[x] = y + 1 <= row[x - x0] * maxY + amplitude * (2.0f * d[x - x0] - 1.0f);
+                    top[x - xStart] = blocks[x] ? y + 1 : top[x - xStart];
+                }
+            }
+        }
+        //Columns with blocks above the box keep their heights, ones whose highest block the box cleared are scanned
+        for (int z = zBegin; z < zEnd; z++) {
+            for (int x = xStart; x < xEnd; x++) {
+                int& height = _heights[x + z * _xDim], top = tops[(z - zStart) * (xEnd - xStart) + x - xStart];
+                if (height > yEnd) continue;
+                if (top) height = top;
+                else if (height > yStart) height = heightBelow(x, z, yStart);
+            }
+        }
+    });
+}
+
+template <typename T>
+static void addCount(std::atomic<T>& count, int delta, bool owned)
+{
+    if (owned) count.store(count.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    else count.fetch_add((T)delta, std::memory_order_relaxed);
+}
+
+template <typename T>
+static void updateCounts(std::atomic<T> *counts, const int *news, int *olds, int first, int size, glm::ivec2 whole,
+    glm::ivec2 wholeParents, glm::ivec2 owned)
+{
+    for (int i = 0; i < size; i++) {
+        int cell = first + i;
+        if (cell >= whole.x && cell <= whole.y) {
+            //Parents not whole sum their cells' counts before
+            if ((cell >> 1) < wholeParents.x || (cell >> 1) > wholeParents.y)
+                olds[i] = counts[cell].load(std::memory_order_relaxed);
+            counts[cell].store(news[i], std::memory_order_relaxed);
+        }
+        else if (news[i] != olds[i]) addCount(counts[cell], news[i] - olds[i], cell >= owned.x && cell <= owned.y);
+    }
+}
+
+void Map::writeCounted(glm::ivec3 low, glm::ivec3 high, const std::function<void(int, int)>& write)
+{
+    glm::ivec3 dims = {(int)_xDim, (int)_yDim, (int)_zDim};
+    //Range of cells of a level with every block of theirs in the map from boxLow to boxHigh, empty if none
+    auto inside = [&](int level, glm::ivec3 boxLow, glm::ivec3 boxHigh, glm::ivec3& from, glm::ivec3& to) {
+        from = (boxLow + (1 << level) - 1) >> level;
+        for (int i = 0; i < 3; i++) to[i] = boxHigh[i] >= dims[i] ? (dims[i] - 1) >> level : (boxHigh[i] >> level) - 1;
+    };
+    std::vector<int> news, olds, newSums, oldSums;
+    std::vector<uint8_t> rows;
+    int levels = getOccupancyLevels(), zEnd;
+    editSections(low, high);
+    for (int zBegin = low.z; zBegin < high.z; zBegin = zEnd) {
+        zEnd = std::min((zBegin / COUNT_SLAB + 1) * COUNT_SLAB, high.z);
+        glm::ivec3 slabLow = {low.x, low.y, zBegin}, slabHigh = {high.x, high.y, zEnd};
+        glm::ivec3 first = slabLow >> 1, size = ((slabHigh - 1) >> 1) - first + 1;
+        /*Cells whole in the slab are simply given their new counts. Others add
+        the difference between their blocks in the slab before & after writing,
+        atomically unless no other thread writes to them, which cells in the box
+        are safe from.*/
+        glm::ivec3 wholeFrom, wholeTo;
+        inside(1, slabLow, slabHigh, wholeFrom, wholeTo);
+        olds.assign(size.x * size.y * size.z, 0);
+        for (int y = 0; y < size.y; y++)
+            for (int z = 0; z < size.z; z++) {
+                int cy = first.y + y, cz = first.z + z;
+                bool rowWhole = cy >= wholeFrom.y && cy <= wholeTo.y && cz >= wholeFrom.z && cz <= wholeTo.z;
+                for (int cx = first.x; cx < first.x + size.x; cx++) {
+                    if (rowWhole && cx >= wholeFrom.x && cx <= wholeTo.x) cx = wholeTo.x;
+                    else for (int by = std::max(cy * 2, slabLow.y); by < std::min(cy * 2 + 2, slabHigh.y); by++)
+                        for (int bz = std::max(cz * 2, slabLow.z); bz < std::min(cz * 2 + 2, slabHigh.z); bz++)
+                            for (int bx = std::max(cx * 2, slabLow.x); bx < std::min(cx * 2 + 2, slabHigh.x); bx++)
+                                olds[(y * size.z + z) * size.x + cx - first.x] += row(by, bz)[bx];
+                }
+            }
+        write(zBegin, zEnd);
+        /*Rows of blocks are summed into a row of bytes per row of cells, 8 at a
+        time as no byte sums more than 4 blocks, then pairs of bytes along x.*/
+        int width = slabHigh.x - slabLow.x;
+        rows.assign(size.y * size.z * size.x * 2 + 8, 0);
+        for (int y = slabLow.y; y < slabHigh.y; y++)
+            for (int z = slabLow.z; z < slabHigh.z; z++) {
+                const bool *blocks = row(y, z) + slabLow.x;
+                uint8_t *sums = &rows[(((y >> 1) - first.y) * size.z + (z >> 1) - first.z) * size.x * 2
+                    + slabLow.x - first.x * 2];
+                int x = 0;
+                for (; x + 8 <= width; x += 8) {
+                    uint64_t sum, add;
+                    memcpy(&sum, sums + x, 8);
+                    memcpy(&add, blocks + x, 8);
+                    sum += add;
+                    memcpy(sums + x, &sum, 8);
+                }
+                for (; x < width; x++) sums[x] += blocks[x];
+            }
+        news.resize(olds.size());
+        for (int i = 0; i < (int)news.size(); i++) news[i] = rows[i * 2] + rows[i * 2 + 1];
+
+        for (int level = 1; level < levels; level++) {
+            if (level > 1) {
+                //Sums of the level below's
+                glm::ivec3 coarse = slabLow >> level, coarseSize = ((slabHigh - 1) >> level) - coarse + 1;
+                newSums.assign(coarseSize.x * coarseSize.y * coarseSize.z, 0);
+                oldSums.assign(newSums.size(), 0);
+                for (int y = 0; y < size.y; y++)
+                    for (int z = 0; z < size.z; z++) {
+                        int cells = (y * size.z + z) * size.x, parents = ((((first.y + y) >> 1) - coarse.y) * coarseSize.z
+                            + ((first.z + z) >> 1) - coarse.z) * coarseSize.x - coarse.x;
+                        for (int x = 0; x < size.x; x++) {
+                            newSums[parents + ((first.x + x) >> 1)] += news[cells + x];
+                            oldSums[parents + ((first.x + x) >> 1)] += olds[cells + x];
+                        }
+                    }
+                news.swap(newSums);
+                olds.swap(oldSums);
+                first = coarse;
+                size = coarseSize;
+                inside(level, slabLow, slabHigh, wholeFrom, wholeTo);
+            }
+            glm::ivec3 parentsFrom(1), parentsTo(0), ownedFrom, ownedTo;
+            if (level + 1 < levels) inside(level + 1, slabLow, slabHigh, parentsFrom, parentsTo);
+            inside(level, low, high, ownedFrom, ownedTo);
+            glm::ivec3 levelDims = getOccupancyDims(level);
+            for (int y = 0; y < size.y; y++)
+                for (int z = 0; z < size.z; z++) {
+                    int cy = first.y + y, cz = first.z + z, cells = (y * size.z + z) * size.x;
+                    size_t counts = cy * levelDims.x * levelDims.z + cz * levelDims.x;
+                    //Ranges along x of cells, parents & cells owned in this row, empty if the row is outside them
+                    auto along = [&](glm::ivec3 from, glm::ivec3 to, int shift) {
+                        bool in = (cy >> shift) >= from.y && (cy >> shift) <= to.y && (cz >> shift) >= from.z
+                            && (cz >> shift) <= to.z;
+                        return in ? glm::ivec2(from.x, to.x) : glm::ivec2(1, 0);
+                    };
+                    glm::ivec2 whole = along(wholeFrom, wholeTo, 0), wholeParents = along(parentsFrom, parentsTo, 1);
+                    glm::ivec2 owned = along(ownedFrom, ownedTo, 0);
+                    if (level <= BYTE_LEVELS) updateCounts(&_byteOccupancy[level - 1][counts], &news[cells], &olds[cells],
+                        first.x, size.x, whole, wholeParents, owned);
+                    else updateCounts(&_occupancy[level - BYTE_LEVELS - 1][counts], &news[cells], &olds[cells],
+                        first.x, size.x, whole, wholeParents, owned);
+                }
+        }
+    }
+    editSections(low, high);
+}
+
 bool Map::planeIntersectsMap(glm::vec3 position, glm::vec2 dimensions)
 {
     glm::vec3 corner = position;
     //Center around position
-    corner.x -= dimensions.x / 2; 
+    corner.x -= dimensions.x / 2;
     corner.z -= dimensions.y / 2;
-    for (int i = 0; i < 4; i++) {
-        glm::vec3 curPoint = corner + glm::vec3{((i / 2) % 2) * dimensions.x, 0, (i % 2)*dimensions.y};
-        if (at(curPoint)) return true;
+    //Every block between the corners, which for sizes under a block are just the corners' blocks
+    int y = (int)floorf(corner.y);
+    return regionHasSolid((int)floorf(corner.x), y, (int)floorf(corner.z),
+        (int)floorf(corner.x + dimensions.x), y, (int)floorf(corner.z + dimensions.y));
+}
+
+bool Map::cuboidIntersectsMap(glm::vec3 position, glm::vec3 dimensions)
+{
+    //Planes at position.y & every whole block below it within the height, as one region
+    glm::vec3 corner = position;
+    corner.x -= dimensions.x / 2;
+    corner.z -= dimensions.z / 2;
+    int top = (int)floorf(corner.y);
+    int layers = (int)ceilf(dimensions.y);
+    if (layers <= 0) return false;
+    return regionHasSolid((int)floorf(corner.x), top - (layers - 1), (int)floorf(corner.z),
+        (int)floorf(corner.x + dimensions.x), top, (int)floorf(corner.z + dimensions.z));
+}
+
+bool Map::regionHasSolid(int x0, int y0, int z0, int x1, int y1, int z1) const
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    z0 = std::max(z0, 0);
+    x1 = std::min(x1, (int)_xDim - 1);
+    y1 = std::min(y1, (int)_yDim - 1);
+    z1 = std::min(z1, (int)_zDim - 1);
+    if (x0 > x1 || y0 > y1 || z0 > z1) return false;
+    //Smallest cell holding the region, where the cells of its corners meet
+    int level = 0;
+    while (((x0 ^ x1) | (y0 ^ y1) | (z0 ^ z1)) >> level) level++;
+    glm::ivec3 low = {x0, y0, z0};
+    return cellOverlapsSolid(level, low >> level, low, {x1, y1, z1});
+}
+
+int Map::countSolid(int x0, int y0, int z0, int x1, int y1, int z1) const
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    z0 = std::max(z0, 0);
+    x1 = std::min(x1, (int)_xDim - 1);
+    y1 = std::min(y1, (int)_yDim - 1);
+    z1 = std::min(z1, (int)_zDim - 1);
+    if (x0 > x1 || y0 > y1 || z0 > z1) return 0;
+    glm::ivec3 low = {x0, y0, z0}, high = {x1, y1, z1}, dims = {(int)_xDim, (int)_yDim, (int)_zDim};
+    //Maps of a section or less have no pyramid level for sections
+    bool counted = SECTION_LEVEL < getOccupancyLevels();
+    int solid = 0;
+    for (int sy = y0 / CHUNK_SIZE; sy <= y1 / CHUNK_SIZE; sy++) {
+        for (int sz = z0 / CHUNK_SIZE; sz <= z1 / CHUNK_SIZE; sz++) {
+            for (int sx = x0 / CHUNK_SIZE; sx <= x1 / CHUNK_SIZE; sx++) {
+                //The region in the section from & to exclusive, & the section's blocks in the map
+                glm::ivec3 section = {sx, sy, sz}, first = section * CHUNK_SIZE;
+                glm::ivec3 from = glm::max(low, first) - first, to = glm::min(high, first + CHUNK_SIZE - 1) - first + 1;
+                glm::ivec3 size = glm::min(first + CHUNK_SIZE, dims) - first;
+                if (counted) {
+                    int sectionSolid = occupancy(SECTION_LEVEL, sx, sy, sz);
+                    if (!sectionSolid) continue;
+                    if (from == glm::ivec3(0) && to == size) {
+                        solid += sectionSolid;
+                        continue;
+                    }
+                    if (sectionSolid == size.x * size.y * size.z) {
+                        solid += (to.x - from.x) * (to.y - from.y) * (to.z - from.z);
+                        continue;
+                    }
+                }
+                std::shared_ptr<const uint16_t[]> sums = volumeTable(section);
+                auto sum = [&sums](int x, int y, int z) {
+                    return (int)sums[(y * (CHUNK_SIZE + 1) + z) * (CHUNK_SIZE + 1) + x];
+                };
+                solid += sum(to.x, to.y, to.z) - sum(from.x, to.y, to.z) - sum(to.x, from.y, to.z) - sum(to.x, to.y, from.z)
+                    + sum(from.x, from.y, to.z) + sum(from.x, to.y, from.z) + sum(to.x, from.y, from.z)
+                    - sum(from.x, from.y, from.z);
+            }
+        }
     }
+    return solid;
+}
+
+int Map::countSolid(glm::vec3 min, glm::vec3 max) const
+{
+    if (glm::any(glm::lessThanEqual(max, min))) return 0;
+    glm::ivec3 low = glm::floor(min), high = glm::ceil(max) - 1.0f;
+    return countSolid(low.x, low.y, low.z, high.x, high.y, high.z);
+}
+
+void Map::editSections(glm::ivec3 low, glm::ivec3 high)
+{
+    glm::ivec3 dims = getSectionDims(), from = low / CHUNK_SIZE, to = (high - 1) / CHUNK_SIZE;
+    for (int y = from.y; y <= to.y; y++)
+        for (int z = from.z; z <= to.z; z++)
+            for (int x = from.x; x <= to.x; x++)
+                _sectionEdits[x + y * dims.x * dims.z + z * dims.x].fetch_add(1, std::memory_order_acq_rel);
+}
+
+std::shared_ptr<const uint16_t[]> Map::volumeTable(glm::ivec3 section) const
+{
+    glm::ivec3 dims = getSectionDims();
+    int index = section.x + section.y * dims.x * dims.z + section.z * dims.x;
+    if (_volumesBuilt[index].load(std::memory_order_acquire) == _sectionEdits[index].load(std::memory_order_acquire))
+        return std::atomic_load(&_volumeTables[index]);
+    std::lock_guard<std::mutex> lock(_volumeMutex);
+    uint32_t edits = _sectionEdits[index].load(std::memory_order_acquire);
+    if (_volumesBuilt[index].load(std::memory_order_relaxed) == edits) return std::atomic_load(&_volumeTables[index]);
+    //Built afresh, as other threads may still be reading the table it replaces
+    const int side = CHUNK_SIZE + 1;
+    std::shared_ptr<uint16_t[]> table(new uint16_t[side * side * side]());
+    glm::ivec3 first = section * CHUNK_SIZE;
+    glm::ivec3 size = glm::min(first + CHUNK_SIZE, glm::ivec3(_xDim, _yDim, _zDim)) - first;
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            //Blocks so far along the row, plus the sums behind along z & below, less the blocks both count
+            uint16_t *sums = &table[((y + 1) * side + z + 1) * side + 1];
+            const uint16_t *behind = sums - side, *below = sums - side * side, *both = below - side;
+            bool inside = y < size.y && z < size.z;
+            const bool *blocks = inside ? row(first.y + y, first.z + z) + first.x : NULL;
+            int width = inside ? size.x : 0;
+            uint16_t along = 0;
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                along += x < width && blocks[x];
+                sums[x] = along + behind[x] + below[x] - both[x];
+            }
+        }
+    }
+    std::atomic_store(&_volumeTables[index], std::shared_ptr<const uint16_t[]>(table));
+    /*Edits bump the count before & after writing, so a table built while any
+    were under way is used once but left out of date, to be built again*/
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_sectionEdits[index].load(std::memory_order_relaxed) == edits)
+        _volumesBuilt[index].store(edits, std::memory_order_release);
+    return table;
+}
+
+bool Map::cellOverlapsSolid(int level, glm::ivec3 cell, glm::ivec3 low, glm::ivec3 high) const
+{
+    glm::ivec3 first = cell << level, last = first + (1 << level) - 1;
+    glm::ivec3 from = glm::max(first, low), to = glm::min(last, high);
+    if (level) {
+        uint32_t solid = occupancy(level, cell.x, cell.y, cell.z);
+        if (!solid) return false;
+        if (solid == (uint64_t)1 << 3 * level || (from == first && to == last)) return true;
+    }
+    //Cells of a few blocks are cheaper to test as rows than to descend
+    if (level <= 2) {
+        bool (*anySolid)(const bool*, int) = simdKernels().anySolid;
+        for (int y = from.y; y <= to.y; y++)
+            for (int z = from.z; z <= to.z; z++)
+                if (anySolid(row(y, z) + from.x, to.x - from.x + 1)) return true;
+        return false;
+    }
+    from >>= level - 1;
+    to >>= level - 1;
+    for (int y = from.y; y <= to.y; y++)
+        for (int z = from.z; z <= to.z; z++)
+            for (int x = from.x; x <= to.x; x++)
+                if (cellOverlapsSolid(level - 1, {x, y, z}, low, high)) return true;
     return false;
 }
 
-bool Map::cuboidIntersectsMap(glm::vec3 position, glm::vec3 dimensions)
+bool Map::sweepBox(glm::vec3 min, glm::vec3 max, glm::vec3 motion, SweepHit& hit) const
 {
-    glm::vec2 xzDims = {dimensions.x, dimensions.z};
-    for (int i = 0; i < dimensions.y; i++)
-    {
-        if (planeIntersectsMap(position - glm::vec3{0.0f, static_cast<float>(i), 0.0f}, xzDims))
+    hit = {1.0f, {0, 0, 0}};
+    /*Per axis, the layer of blocks the leading face is in & the time it reaches
+    the next one. Layers are stepped through in order of time, each tested across
+    the blocks the box covers on the other axes then. Leading layers are tracked
+    as integers, so a layer entered on one axis is covered when another axis
+    steps at the same time & corner blocks aren't missed.*/
+    int step[3], lead[3];
+    float next[3];
+    int dims[3] = {(int)_xDim, (int)_yDim, (int)_zDim};
+    for (int i = 0; i < 3; i++) {
+        step[i] = motion[i] > 0 ? 1 : motion[i] < 0 ? -1 : 0;
+        //Boxes beyond the map & not moving back towards it, such as ones falling out of it, can't hit anything
+        if ((step[i] >= 0 && min[i] >= dims[i]) || (step[i] <= 0 && max[i] <= 0)) return false;
+        lead[i] = step[i] < 0 ? (int)floorf(min[i]) : (int)ceilf(max[i]) - 1;
+        if (step[i] > 0) next[i] = (lead[i] + 1 - max[i]) / motion[i];
+        else if (step[i] < 0) next[i] = (lead[i] - min[i]) / motion[i];
+        else next[i] = INFINITY;
+    }
+    while (true) {
+        int axis = next[0] <= next[1] ? (next[0] <= next[2] ? 0 : 2) : (next[1] <= next[2] ? 1 : 2);
+        float t = next[axis];
+        if (!(t <= 1.0f)) return false;
+        lead[axis] += step[axis];
+        int low[3], high[3];
+        for (int i = 0; i < 3; i++) {
+            if (i == axis) low[i] = high[i] = lead[i];
+            else if (step[i] > 0) {
+                low[i] = (int)floorf(min[i] + motion[i] * t);
+                high[i] = lead[i];
+            }
+            else if (step[i] < 0) {
+                low[i] = lead[i];
+                high[i] = (int)ceilf(max[i] + motion[i] * t) - 1;
+            }
+            else {
+                low[i] = (int)floorf(min[i]);
+                high[i] = (int)ceilf(max[i]) - 1;
+            }
+        }
+        if (regionHasSolid(low[0], low[1], low[2], high[0], high[1], high[2])) {
+            hit.time = t;
+            hit.normal[axis] = -step[axis];
             return true;
+        }
+        if (step[axis] > 0) next[axis] = (lead[axis] + 1 - max[axis]) / motion[axis];
+        else next[axis] = (lead[axis] - min[axis]) / motion[axis];
     }
-    return false;
+}
+
+glm::vec3 Map::slideBox(glm::vec3 min, glm::vec3 max, glm::vec3 motion, glm::bvec3 *blocked) const
+{
+    glm::vec3 offset(0.0f);
+    if (blocked) *blocked = glm::bvec3(false);
+    //Each contact drops an axis, so there are at most 3
+    for (int i = 0; i < 3; i++) {
+        SweepHit hit;
+        if (!sweepBox(min + offset, max + offset, motion, hit)) return offset + motion;
+        int axis = hit.normal.x ? 0 : hit.normal.y ? 1 : 2;
+        glm::vec3 moved = motion * hit.time;
+        /*Stop SWEEP_SKIN short of the face, which lies on a whole block boundary,
+        rather than at the time of contact, so rounding can't leave the box in the
+        block it hit.*/
+        float face = hit.normal[axis] < 0 ? max[axis] + offset[axis] : min[axis] + offset[axis];
+        moved[axis] = roundf(face + moved[axis]) - face + hit.normal[axis] * SWEEP_SKIN;
+        offset += moved;
+        motion *= 1.0f - hit.time;
+        motion[axis] = 0.0f;
+        if (blocked) (*blocked)[axis] = true;
+    }
+    return offset;
 }
 
 bool Map::at(int x, int y, int z) const
@@ -192,7 +748,41 @@ void Map::setAt(int x, int y, int z, bool value)
     if (x >= _xDim || y >= _yDim || z >= _zDim
         || x < 0 || y < 0 || z < 0) return;
     int idx = x + y * _xDim * _zDim + z * _xDim;
+    if (_map[idx] == value) return;
+    editSections({x, y, z}, {x + 1, y + 1, z + 1});
     _map[idx] = value;
+    for (int level = 1; level < getOccupancyLevels(); level++) {
+        glm::ivec3 dims = getOccupancyDims(level);
+        size_t cell = (x >> level) + (y >> level) * dims.x * dims.z + (z >> level) * dims.x;
+        if (level <= BYTE_LEVELS) addCount(_byteOccupancy[level - 1][cell], value ? 1 : -1, false);
+        else addCount(_occupancy[level - BYTE_LEVELS - 1][cell], value ? 1 : -1, false);
+    }
+    editSections({x, y, z}, {x + 1, y + 1, z + 1});
+    int& height = _heights[x + z * _xDim];
+    if (value) height = std::max(height, y + 1);
+    else if (height == y + 1) height = heightBelow(x, z, y);
+}
+
+int Map::heightBelow(int x, int z, int y) const
+{
+    while (y > 0 && !at(x, y - 1, z)) y--;
+    return y;
+}
+
+void Map::columnHeights(int x0, int z0, int width, int depth, int *heights) const
+{
+    for (int z = 0; z < depth; z++) {
+        int *row = heights + z * width;
+        if (z0 + z < 0 || z0 + z >= (int)_zDim) {
+            std::fill_n(row, width, 0);
+            continue;
+        }
+        //Copy the columns in the map, those outside it have none
+        int xStart = glm::clamp(-x0, 0, width), xEnd = glm::clamp((int)_xDim - x0, xStart, width);
+        std::fill_n(row, xStart, 0);
+        std::copy_n(&_heights[x0 + xStart + (z0 + z) * _xDim], xEnd - xStart, row + xStart);
+        std::fill_n(row + xEnd, width - xEnd, 0);
+    }
 }
 
 std::bitset<6> Map::surroundingBlocks(int x, int y, int z) const
@@ -0,0 +1,19 @@
+#include "commandbuffer.h"
+#include <algorithm>
+
+void CommandBuffer::reset(unsigned int threads)
+{
+    //Buffers are cleared rather than freed, so recording doesn't allocate after the first frames
+    if (_threadPackets.size() < threads) _threadPackets.resize(threads);
+    for (std::vector<DrawPacket>& packets : _threadPackets) packets.clear();
+    _sorted.clear();
+}
+
+const std::vector<DrawPacket>& CommandBuffer::merge()
+{
+    for (const std::vector<DrawPacket>& packets : _threadPackets)
+        _sorted.insert(_sorted.end(), packets.begin(), packets.end());
+    //Keys are unique per chunk, so the order doesn't depend on which thread recorded what
+    std::sort(_sorted.begin(), _sorted.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+    return _sorted;
+}
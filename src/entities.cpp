@@ -0,0 +1,83 @@
+#include "entities.h"
+#include <algorithm>
+
+#include "base.h"
+#include "simd.h"
+#include "threadpool.h"
+
+int EntityStore::spawn(glm::vec3 position, glm::vec3 size, glm::vec3 velocity)
+{
+    _x.push_back(position.x);
+    _y.push_back(position.y);
+    _z.push_back(position.z);
+    _vx.push_back(velocity.x);
+    _vy.push_back(velocity.y);
+    _vz.push_back(velocity.z);
+    _ay.push_back(0.0f);
+    _sizeX.push_back(size.x);
+    _sizeY.push_back(size.y);
+    _sizeZ.push_back(size.z);
+    _flags.push_back(0);
+    _rise.push_back(0.0f);
+    return (int)_x.size() - 1;
+}
+
+void EntityStore::despawn(int entity)
+{
+    std::vector<float> *components[] = {&_x, &_y, &_z, &_vx, &_vy, &_vz, &_ay, &_sizeX, &_sizeY, &_sizeZ, &_rise};
+    for (std::vector<float> *c : components) {
+        (*c)[entity] = c->back();
+        c->pop_back();
+    }
+    _flags[entity] = _flags.back();
+    _flags.pop_back();
+}
+
+void EntityStore::clear()
+{
+    std::vector<float> *components[] = {&_x, &_y, &_z, &_vx, &_vy, &_vz, &_ay, &_sizeX, &_sizeY, &_sizeZ, &_rise};
+    for (std::vector<float> *c : components) c->clear();
+    _flags.clear();
+}
+
+void EntityStore::update(const Map& map, float timeStep, float gravity)
+{
+    int batches = (size() + ENTITY_BATCH - 1) / ENTITY_BATCH;
+    for (int batch = 0; batch < batches; batch++) collideBatch(map, timeStep, gravity, batch);
+}
+
+void EntityStore::update(const Map& map, float timeStep, float gravity, ThreadPool& pool)
+{
+    int batches = (size() + ENTITY_BATCH - 1) / ENTITY_BATCH;
+    pool.parallelFor(batches, [&](int batch, int) { collideBatch(map, timeStep, gravity, batch); });
+}
+
+void EntityStore::collideBatch(const Map& map, float timeStep, float gravity, int batch)
+{
+    int begin = batch * ENTITY_BATCH, end = std::min(begin + ENTITY_BATCH, size());
+    //Gravity for the whole batch at once, while its components are in cache for collision
+    simdKernels().verletStep(&_vy[begin], &_ay[begin], &_flags[begin], gravity, timeStep, end - begin, &_rise[begin]);
+    for (int e = begin; e < end; e++) {
+        glm::vec3 min = {_x[e] - _sizeX[e] / 2, _y[e], _z[e] - _sizeZ[e] / 2};
+        glm::vec3 max = {_x[e] + _sizeX[e] / 2, _y[e] + _sizeY[e], _z[e] + _sizeZ[e] / 2};
+        glm::vec3 motion = {_vx[e] * timeStep, _rise[e], _vz[e] * timeStep};
+        glm::bvec3 blocked;
+        glm::vec3 offset = map.slideBox(min, max, motion, &blocked);
+        _x[e] += offset.x;
+        _y[e] += offset.y;
+        _z[e] += offset.z;
+        //Landed or hit a ceiling
+        if (blocked.y) {
+            _vy[e] = 0.0f;
+            _ay[e] = 0.0f;
+        }
+        /*Standing if there's a block within the gap slideBox leaves below, known
+        already if the entity just landed. Otherwise probed with a short sweep down.*/
+        bool grounded = blocked.y && motion.y < 0;
+        if (!grounded && motion.y <= 0) {
+            SweepHit hit;
+            grounded = map.sweepBox(min + offset, max + offset, {0.0f, -2 * SWEEP_SKIN, 0.0f}, hit);
+        }
+        _flags[e] = grounded ? _flags[e] | EntityFlags::Grounded : _flags[e] & ~EntityFlags::Grounded;
+    }
+}
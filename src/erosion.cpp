@@ -0,0 +1,375 @@
+#include "erosion.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "simd.h"
+#include "threadpool.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define EROSION_SIMD
+#include <immintrin.h>
+#endif
+
+//Width & depth of a tile's interior
+#define EROSION_TILE 256
+//Iterations a tile runs between halo exchanges
+#define EROSION_ROUND 4
+//Cells an iteration reads around a cell: flux, then flow & slope, then sediment advection
+#define EROSION_REACH 3
+//Water depth velocities are measured against at least, so dry cells don't divide by 0
+#define EROSION_MIN_DEPTH 0.001f
+
+/*Working copy of a tile & its halo, reused across tiles by one thread. Outflow
+is towards the neighbour at x - 1 (L), x + 1 (R), z - 1 (U) & z + 1 (D).
+*/
+struct ErosionTile {
+    int width, depth;
+    float *b, *d, *s;          //terrain, water & sediment
+    float *fL, *fR, *fU, *fD;
+    float *u, *v;              //velocity in cells per iteration, at most 1
+    float *flow;               //water flux through the cell, for capacity
+    float *b2, *s2;            //terrain & sediment after erosion
+    float *zeros;              //inflow from beyond the map
+    std::vector<float> storage;
+
+    void resize(int w, int h) {
+        width = w;
+        depth = h;
+        int cells = w * h;
+        storage.resize(13 * cells + w);
+        float **arrays[] = {&b, &d, &s, &fL, &fR, &fU, &fD, &u, &v, &flow, &b2, &s2};
+        for (int k = 0; k < 12; k++) *arrays[k] = storage.data() + k * cells;
+        zeros = storage.data() + 12 * cells;
+        std::fill_n(zeros, w, 0.0f);
+    }
+};
+
+typedef void (*ErosionRowKernel)(ErosionTile& t, int z, const ErosionParams& p);
+
+/*Single cell of each pass, used by the scalar path & for the edges of the AVX2
+path. Neighbours beyond the map are the cell itself, so water doesn't flow out.
+*/
+static inline void fluxCell(ErosionTile& t, int i, int left, int right, int up, int down, float rain) {
+    float h = t.b[i] + t.d[i];
+    float fl = std::max(h - (t.b[left] + t.d[left]), 0.0f) * 0.25f;
+    float fr = std::max(h - (t.b[right] + t.d[right]), 0.0f) * 0.25f;
+    float fu = std::max(h - (t.b[up] + t.d[up]), 0.0f) * 0.25f;
+    float fd = std::max(h - (t.b[down] + t.d[down]), 0.0f) * 0.25f;
+    //Scaled down if it would take more water than the cell has
+    float total = fl + fr + fu + fd;
+    float water = t.d[i] + rain;
+    float scale = total > water ? water / total : 1.0f;
+    t.fL[i] = fl * scale;
+    t.fR[i] = fr * scale;
+    t.fU[i] = fu * scale;
+    t.fD[i] = fd * scale;
+}
+
+static inline void waterCell(ErosionTile& t, int i, float inL, float inR, float inU, float inD, float rain) {
+    float water = t.d[i] + rain;
+    float in = inL + inR + inU + inD;
+    float out = t.fL[i] + t.fR[i] + t.fU[i] + t.fD[i];
+    float depth = std::max(water + in - out, 0.0f);
+    //Net flux through the cell along each axis
+    float vx = (inL - t.fL[i] + (t.fR[i] - inR)) * 0.5f;
+    float vz = (inU - t.fU[i] + (t.fD[i] - inD)) * 0.5f;
+    float mean = std::max((water + depth) * 0.5f, EROSION_MIN_DEPTH);
+    t.u[i] = std::min(std::max(vx / mean, -1.0f), 1.0f);
+    t.v[i] = std::min(std::max(vz / mean, -1.0f), 1.0f);
+    t.flow[i] = sqrtf(vx * vx + vz * vz);
+    t.d[i] = depth;
+}
+
+static inline void erodeCell(ErosionTile& t, int i, int left, int right, int up, int down, const ErosionParams& p,
+        float keep) {
+    float gx = (t.b[right] - t.b[left]) * 0.5f;
+    float gz = (t.b[down] - t.b[up]) * 0.5f;
+    float tilt = gx * gx + gz * gz;
+    float slope = std::max(sqrtf(tilt / (1.0f + tilt)), p.minSlope);
+    //Pick up a share of spare capacity, or drop a share of the excess
+    float excess = p.capacity * slope * t.flow[i] - t.s[i];
+    float delta = (excess > 0.0f ? p.erosion : p.deposition) * excess;
+    t.b2[i] = t.b[i] - delta;
+    t.s2[i] = t.s[i] + delta;
+    t.d[i] *= keep;
+}
+
+/*Sediment arriving at a cell is taken from where the water came from, bilinearly.
+Weights come from the velocity alone rather than a position, so they round the
+same wherever the cell lies in its tile.
+*/
+static inline void advectCell(ErosionTile& t, int x, int z) {
+    int i = z * t.width + x;
+    float u = t.u[i], v = t.v[i];
+    int sx = u > 0.0f ? -1 : 0, sz = v > 0.0f ? -1 : 0;
+    float fx = u > 0.0f ? 1.0f - u : -u, fz = v > 0.0f ? 1.0f - v : -v;
+    int x0 = std::max(x + sx, 0), x1 = std::min(x + sx + 1, t.width - 1);
+    int z0 = std::max(z + sz, 0), z1 = std::min(z + sz + 1, t.depth - 1);
+    const float *r0 = t.s2 + z0 * t.width, *r1 = t.s2 + z1 * t.width;
+    float top = r0[x0] + (r0[x1] - r0[x0]) * fx;
+    float bottom = r1[x0] + (r1[x1] - r1[x0]) * fx;
+    t.s[i] = top + (bottom - top) * fz;
+}
+
+static void fluxRowScalar(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    int up = z > 0 ? -w : 0, down = z + 1 < t.depth ? w : 0;
+    for (int x = 0; x < w; x++) {
+        int i = row + x;
+        fluxCell(t, i, x > 0 ? i - 1 : i, x + 1 < w ? i + 1 : i, i + up, i + down, p.rain);
+    }
+}
+
+static void waterRowScalar(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    const float *above = z > 0 ? t.fD + row - w : t.zeros;
+    const float *below = z + 1 < t.depth ? t.fU + row + w : t.zeros;
+    for (int x = 0; x < w; x++) {
+        int i = row + x;
+        waterCell(t, i, x > 0 ? t.fR[i - 1] : 0.0f, x + 1 < w ? t.fL[i + 1] : 0.0f, above[x], below[x], p.rain);
+    }
+}
+
+static void erodeRowScalar(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    int up = z > 0 ? -w : 0, down = z + 1 < t.depth ? w : 0;
+    float keep = 1.0f - p.evaporation;
+    for (int x = 0; x < w; x++) {
+        int i = row + x;
+        erodeCell(t, i, x > 0 ? i - 1 : i, x + 1 < w ? i + 1 : i, i + up, i + down, p, keep);
+    }
+}
+
+static void advectRowScalar(ErosionTile& t, int z, const ErosionParams&) {
+    for (int x = 0; x < t.width; x++) advectCell(t, x, z);
+}
+
+#ifdef EROSION_SIMD
+/*Rows 8 cells at a time, the first & last cell of a row go through the scalar
+cells as their neighbours are clamped, inlined & compiled for AVX2 like the rest.
+Same operations in the same order as the cells: std::max(x, c) is
+_mm256_max_ps(c, x) & std::min(x, c) is _mm256_min_ps(c, x).
+*/
+__attribute__((target("avx2")))
+static void fluxRowAVX2(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    if (w < 2) return fluxRowScalar(t, z, p);
+    int up = z > 0 ? -w : 0, down = z + 1 < t.depth ? w : 0;
+    fluxCell(t, row, row, row + 1, row + up, row + down, p.rain);
+    __m256 zero = _mm256_setzero_ps(), quarter = _mm256_set1_ps(0.25f), one = _mm256_set1_ps(1.0f);
+    __m256 rain = _mm256_set1_ps(p.rain);
+    int x = 1;
+    for (; x + 8 <= w - 1; x += 8) {
+        int i = row + x;
+        __m256 d = _mm256_loadu_ps(t.d + i);
+        __m256 h = _mm256_add_ps(_mm256_loadu_ps(t.b + i), d);
+        __m256 fl = _mm256_mul_ps(_mm256_max_ps(zero, _mm256_sub_ps(h, _mm256_add_ps(_mm256_loadu_ps(t.b + i - 1), _mm256_loadu_ps(t.d + i - 1)))), quarter);
+        __m256 fr = _mm256_mul_ps(_mm256_max_ps(zero, _mm256_sub_ps(h, _mm256_add_ps(_mm256_loadu_ps(t.b + i + 1), _mm256_loadu_ps(t.d + i + 1)))), quarter);
+        __m256 fu = _mm256_mul_ps(_mm256_max_ps(zero, _mm256_sub_ps(h, _mm256_add_ps(_mm256_loadu_ps(t.b + i + up), _mm256_loadu_ps(t.d + i + up)))), quarter);
+        __m256 fd = _mm256_mul_ps(_mm256_max_ps(zero, _mm256_sub_ps(h, _mm256_add_ps(_mm256_loadu_ps(t.b + i + down), _mm256_loadu_ps(t.d + i + down)))), quarter);
+        __m256 total = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(fl, fr), fu), fd);
+        __m256 water = _mm256_add_ps(d, rain);
+        __m256 scale = _mm256_blendv_ps(one, _mm256_div_ps(water, total), _mm256_cmp_ps(total, water, _CMP_GT_OQ));
+        _mm256_storeu_ps(t.fL + i, _mm256_mul_ps(fl, scale));
+        _mm256_storeu_ps(t.fR + i, _mm256_mul_ps(fr, scale));
+        _mm256_storeu_ps(t.fU + i, _mm256_mul_ps(fu, scale));
+        _mm256_storeu_ps(t.fD + i, _mm256_mul_ps(fd, scale));
+    }
+    for (; x < w - 1; x++) {
+        int i = row + x;
+        fluxCell(t, i, i - 1, i + 1, i + up, i + down, p.rain);
+    }
+    int i = row + w - 1;
+    fluxCell(t, i, i - 1, i, i + up, i + down, p.rain);
+}
+
+__attribute__((target("avx2")))
+static void waterRowAVX2(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    if (w < 2) return waterRowScalar(t, z, p);
+    const float *above = z > 0 ? t.fD + row - w : t.zeros;
+    const float *below = z + 1 < t.depth ? t.fU + row + w : t.zeros;
+    waterCell(t, row, 0.0f, t.fL[row + 1], above[0], below[0], p.rain);
+    __m256 zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f);
+    __m256 negOne = _mm256_set1_ps(-1.0f), minDepth = _mm256_set1_ps(EROSION_MIN_DEPTH), rain = _mm256_set1_ps(p.rain);
+    int x = 1;
+    for (; x + 8 <= w - 1; x += 8) {
+        int i = row + x;
+        __m256 inL = _mm256_loadu_ps(t.fR + i - 1), inR = _mm256_loadu_ps(t.fL + i + 1);
+        __m256 inU = _mm256_loadu_ps(above + x), inD = _mm256_loadu_ps(below + x);
+        __m256 fl = _mm256_loadu_ps(t.fL + i), fr = _mm256_loadu_ps(t.fR + i);
+        __m256 fu = _mm256_loadu_ps(t.fU + i), fd = _mm256_loadu_ps(t.fD + i);
+        __m256 water = _mm256_add_ps(_mm256_loadu_ps(t.d + i), rain);
+        __m256 in = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(inL, inR), inU), inD);
+        __m256 out = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(fl, fr), fu), fd);
+        __m256 depth = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_add_ps(water, in), out));
+        __m256 vx = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(inL, fl), _mm256_sub_ps(fr, inR)), half);
+        __m256 vz = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(inU, fu), _mm256_sub_ps(fd, inD)), half);
+        __m256 mean = _mm256_max_ps(minDepth, _mm256_mul_ps(_mm256_add_ps(water, depth), half));
+        _mm256_storeu_ps(t.u + i, _mm256_min_ps(one, _mm256_max_ps(negOne, _mm256_div_ps(vx, mean))));
+        _mm256_storeu_ps(t.v + i, _mm256_min_ps(one, _mm256_max_ps(negOne, _mm256_div_ps(vz, mean))));
+        _mm256_storeu_ps(t.flow + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vz, vz))));
+        _mm256_storeu_ps(t.d + i, depth);
+    }
+    for (; x < w - 1; x++) {
+        int i = row + x;
+        waterCell(t, i, t.fR[i - 1], t.fL[i + 1], above[x], below[x], p.rain);
+    }
+    int i = row + w - 1;
+    waterCell(t, i, t.fR[i - 1], 0.0f, above[w - 1], below[w - 1], p.rain);
+}
+
+__attribute__((target("avx2")))
+static void erodeRowAVX2(ErosionTile& t, int z, const ErosionParams& p) {
+    int w = t.width, row = z * w;
+    if (w < 2) return erodeRowScalar(t, z, p);
+    int up = z > 0 ? -w : 0, down = z + 1 < t.depth ? w : 0;
+    float keep = 1.0f - p.evaporation;
+    erodeCell(t, row, row, row + 1, row + up, row + down, p, keep);
+    __m256 zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f);
+    __m256 minSlope = _mm256_set1_ps(p.minSlope), capacity = _mm256_set1_ps(p.capacity);
+    __m256 erosion = _mm256_set1_ps(p.erosion), deposition = _mm256_set1_ps(p.deposition);
+    __m256 keepV = _mm256_set1_ps(keep);
+    int x = 1;
+    for (; x + 8 <= w - 1; x += 8) {
+        int i = row + x;
+        __m256 b = _mm256_loadu_ps(t.b + i), s = _mm256_loadu_ps(t.s + i);
+        __m256 gx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(t.b + i + 1), _mm256_loadu_ps(t.b + i - 1)), half);
+        __m256 gz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(t.b + i + down), _mm256_loadu_ps(t.b + i + up)), half);
+        __m256 tilt = _mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gz, gz));
+        __m256 slope = _mm256_max_ps(minSlope, _mm256_sqrt_ps(_mm256_div_ps(tilt, _mm256_add_ps(one, tilt))));
+        __m256 excess = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(capacity, slope), _mm256_loadu_ps(t.flow + i)), s);
+        __m256 rate = _mm256_blendv_ps(deposition, erosion, _mm256_cmp_ps(excess, zero, _CMP_GT_OQ));
+        __m256 delta = _mm256_mul_ps(rate, excess);
+        _mm256_storeu_ps(t.b2 + i, _mm256_sub_ps(b, delta));
+        _mm256_storeu_ps(t.s2 + i, _mm256_add_ps(s, delta));
+        _mm256_storeu_ps(t.d + i, _mm256_mul_ps(_mm256_loadu_ps(t.d + i), keepV));
+    }
+    for (; x < w - 1; x++) {
+        int i = row + x;
+        erodeCell(t, i, i - 1, i + 1, i + up, i + down, p, keep);
+    }
+    int i = row + w - 1;
+    erodeCell(t, i, i - 1, i, i + up, i + down, p, keep);
+}
+
+__attribute__((target("avx2")))
+static void advectRowAVX2(ErosionTile& t, int z, const ErosionParams&) {
+    int w = t.width, row = z * w;
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), sign = _mm256_set1_ps(-0.0f);
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), oneI = _mm256_set1_epi32(1), zeroI = _mm256_setzero_si256();
+    __m256i lastX = _mm256_set1_epi32(w - 1), stride = _mm256_set1_epi32(w);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        int i = row + x;
+        __m256 u = _mm256_loadu_ps(t.u + i), v = _mm256_loadu_ps(t.v + i);
+        //Comparison masks are all ones, ie -1, where the step back is taken
+        __m256 backX = _mm256_cmp_ps(u, zero, _CMP_GT_OQ), backZ = _mm256_cmp_ps(v, zero, _CMP_GT_OQ);
+        __m256 fx = _mm256_blendv_ps(_mm256_xor_ps(u, sign), _mm256_sub_ps(one, u), backX);
+        __m256 fz = _mm256_blendv_ps(_mm256_xor_ps(v, sign), _mm256_sub_ps(one, v), backZ);
+        __m256i px = _mm256_add_epi32(_mm256_add_epi32(_mm256_set1_epi32(x), lanes), _mm256_castps_si256(backX));
+        __m256i pz = _mm256_add_epi32(_mm256_set1_epi32(z), _mm256_castps_si256(backZ));
+        __m256i x0 = _mm256_max_epi32(px, zeroI), x1 = _mm256_min_epi32(_mm256_add_epi32(px, oneI), lastX);
+        __m256i r0 = _mm256_mullo_epi32(_mm256_max_epi32(pz, zeroI), stride);
+        __m256i r1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(pz, oneI), _mm256_set1_epi32(t.depth - 1)), stride);
+        __m256 a00 = _mm256_i32gather_ps(t.s2, _mm256_add_epi32(r0, x0), 4);
+        __m256 a01 = _mm256_i32gather_ps(t.s2, _mm256_add_epi32(r0, x1), 4);
+        __m256 a10 = _mm256_i32gather_ps(t.s2, _mm256_add_epi32(r1, x0), 4);
+        __m256 a11 = _mm256_i32gather_ps(t.s2, _mm256_add_epi32(r1, x1), 4);
+        __m256 top = _mm256_add_ps(a00, _mm256_mul_ps(_mm256_sub_ps(a01, a00), fx));
+        __m256 bottom = _mm256_add_ps(a10, _mm256_mul_ps(_mm256_sub_ps(a11, a10), fx));
+        _mm256_storeu_ps(t.s + i, _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fz)));
+    }
+    for (; x < w; x++) advectCell(t, x, z);
+}
+#endif
+
+//Passes of an iteration, in order
+struct ErosionKernels {
+    ErosionRowKernel passes[4];
+};
+
+static ErosionKernels erosionKernels() {
+#ifdef EROSION_SIMD
+    if (getSimdIsa() >= SimdIsa::AVX2) return {{fluxRowAVX2, waterRowAVX2, erodeRowAVX2, advectRowAVX2}};
+#endif
+    return {{fluxRowScalar, waterRowScalar, erodeRowScalar, advectRowScalar}};
+}
+
+/*Each pass runs a row behind the one before, once the rows either side it reads
+are done, so the rows passes share are still in cache.
+*/
+static void erodeTile(ErosionTile& t, int iterations, const ErosionParams& p, const ErosionKernels& kernels) {
+    for (int it = 0; it < iterations; it++) {
+        for (int z = 0; z < t.depth + 3; z++)
+            for (int k = 0; k < 4; k++)
+                if (z - k >= 0 && z - k < t.depth) kernels.passes[k](t, z - k, p);
+        std::swap(t.b, t.b2);
+    }
+}
+
+/*Rounds of up to EROSION_ROUND iterations. A tile's halo is as wide as the cells
+its iterations reach, so its interior comes out the same as if the whole map
+were updated at once: halo cells go stale from the outside in, but not far
+enough to reach the interior. At the map's edges there is no halo to go stale.
+*/
+static void erode(float *heightmap, int width, int depth, const ErosionParams& params, ThreadPool *pool) {
+    if (width <= 0 || depth <= 0 || params.iterations <= 0) return;
+    size_t cells = (size_t)width * depth;
+    //State at the start of a round & at its end, the heightmap itself holds terrain first
+    std::vector<float> terrain(cells), water[2], sediment[2];
+    float *b[2] = {heightmap, terrain.data()};
+    for (int k = 0; k < 2; k++) {
+        water[k].assign(cells, 0.0f);
+        sediment[k].assign(cells, 0.0f);
+    }
+    for (size_t i = 0; i < cells; i++) heightmap[i] *= params.heightScale;
+
+    ErosionKernels kernels = erosionKernels();
+    int tilesX = (width + EROSION_TILE - 1) / EROSION_TILE, tilesZ = (depth + EROSION_TILE - 1) / EROSION_TILE;
+    std::vector<ErosionTile> scratch(pool ? pool->getThreadCount() : 1);
+    int current = 0;
+    for (int done = 0; done < params.iterations; done += EROSION_ROUND) {
+        int iterations = std::min(EROSION_ROUND, params.iterations - done);
+        int halo = iterations * EROSION_REACH;
+        float *from[3] = {b[current], water[current].data(), sediment[current].data()};
+        float *to[3] = {b[1 - current], water[1 - current].data(), sediment[1 - current].data()};
+        auto tile = [&](int task, int worker) {
+            int x0 = task % tilesX * EROSION_TILE, z0 = task / tilesX * EROSION_TILE;
+            int x1 = std::min(x0 + EROSION_TILE, width), z1 = std::min(z0 + EROSION_TILE, depth);
+            int hx0 = std::max(x0 - halo, 0), hz0 = std::max(z0 - halo, 0);
+            int hx1 = std::min(x1 + halo, width), hz1 = std::min(z1 + halo, depth);
+            ErosionTile& t = scratch[worker];
+            t.resize(hx1 - hx0, hz1 - hz0);
+            for (int z = hz0; z < hz1; z++) {
+                size_t src = (size_t)z * width + hx0, dst = (size_t)(z - hz0) * t.width;
+                memcpy(t.b + dst, from[0] + src, t.width * sizeof(float));
+                memcpy(t.d + dst, from[1] + src, t.width * sizeof(float));
+                memcpy(t.s + dst, from[2] + src, t.width * sizeof(float));
+            }
+            erodeTile(t, iterations, params, kernels);
+            for (int z = z0; z < z1; z++) {
+                size_t dst = (size_t)z * width + x0, src = (size_t)(z - hz0) * t.width + (x0 - hx0);
+                memcpy(to[0] + dst, t.b + src, (x1 - x0) * sizeof(float));
+                memcpy(to[1] + dst, t.d + src, (x1 - x0) * sizeof(float));
+                memcpy(to[2] + dst, t.s + src, (x1 - x0) * sizeof(float));
+            }
+        };
+        if (pool) pool->parallelFor(tilesX * tilesZ, tile);
+        else for (int i = 0; i < tilesX * tilesZ; i++) tile(i, 0);
+        current = 1 - current;
+    }
+
+    //Sediment still carried settles where it is
+    for (size_t i = 0; i < cells; i++) heightmap[i] = (b[current][i] + sediment[current][i]) / params.heightScale;
+}
+
+void erodeHeightmap(float *heightmap, int width, int depth, const ErosionParams& params) {
+    erode(heightmap, width, depth, params, NULL);
+}
+
+void erodeHeightmap(float *heightmap, int width, int depth, const ErosionParams& params, ThreadPool& pool) {
+    erode(heightmap, width, depth, params, &pool);
+}
@@ -0,0 +1,78 @@
+#include "framescheduler.h"
+#include <thread>
+#include <math.h>
+
+#include "GLFW/glfw3.h"
+
+//Bounds of the calibrated wake-up margin, in seconds
+#define MIN_WAKE_MARGIN 0.0002
+#define MAX_WAKE_MARGIN 0.004
+//Rate at which the margin decays back down after a large oversleep
+#define WAKE_MARGIN_DECAY 0.99
+
+FrameScheduler::FrameScheduler(FramePacing mode, double targetFps)
+        : _period(1.0 / targetFps), _wakeMargin(0.001), _started(false) {
+    resetStats();
+    setMode(mode);
+}
+
+void FrameScheduler::setMode(FramePacing mode)
+{
+    //Requires the window's context to be current
+    _mode = mode;
+    glfwSwapInterval(mode == FramePacing::VSync ? 1 : 0);
+}
+
+void FrameScheduler::beginFrame()
+{
+    Clock::time_point now = Clock::now();
+    if (_started) {
+        double frameTime = std::chrono::duration<double>(now - _frameStart).count();
+        _frameTimes.add(frameTime);
+        //Deviation is measured against the target period when capped, otherwise against the mean
+        double deviation = fabs(frameTime - (_mode == FramePacing::Uncapped ? _frameTimes.mean : _period));
+        if (deviation > _maxDeviation) _maxDeviation = deviation;
+    }
+    _started = true;
+    _frameStart = now;
+}
+
+void FrameScheduler::endFrame()
+{
+    //Vsync paces in swap buffers, uncapped doesn't pace at all
+    if (_mode != FramePacing::Hybrid) return;
+
+    Clock::time_point deadline = _frameStart + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(_period));
+    double remaining = std::chrono::duration<double>(deadline - Clock::now()).count();
+
+    //Sleep for all but the wake-up margin, then calibrate margin from how late we woke
+    if (remaining > _wakeMargin) {
+        double requested = remaining - _wakeMargin;
+        Clock::time_point sleepStart = Clock::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(requested));
+        double overshoot = std::chrono::duration<double>(Clock::now() - sleepStart).count() - requested;
+        _wakeMargin = fmax(overshoot, _wakeMargin * WAKE_MARGIN_DECAY);
+        _wakeMargin = fmin(fmax(_wakeMargin, MIN_WAKE_MARGIN), MAX_WAKE_MARGIN);
+    }
+
+    //Spin for the remainder, yielding so other threads on this core can run
+    while (Clock::now() < deadline)
+        std::this_thread::yield();
+}
+
+void FrameScheduler::resetStats()
+{
+    _frameTimes.reset();
+    _maxDeviation = 0.0;
+}
+
+FrameStats FrameScheduler::getStats() const
+{
+    FrameStats stats;
+    stats.frames = _frameTimes.count;
+    stats.meanFrameTime = _frameTimes.mean;
+    stats.jitter = _frameTimes.stddev();
+    stats.maxDeviation = _maxDeviation;
+    return stats;
+}
@@ -0,0 +1,62 @@
+#include "governor.h"
+#include <iostream>
+#include <math.h>
+
+QualityGovernor::QualityGovernor(GovernorInitData g)
+        : _initData(g), _level(g.levels - 1), _average(g.targetFrameTime),
+        _slowFrames(), _fastFrames(), _cooldown() {}
+
+bool QualityGovernor::update(double frameTime)
+{
+    _average += (frameTime - _average) * _initData.smoothing;
+    if (_cooldown > 0) {
+        _cooldown--;
+        return false;
+    }
+
+    //Count consecutive frames outside the dead band around the target
+    double target = _initData.targetFrameTime;
+    if (_average > target * (1.0 + _initData.upperBand)) _slowFrames++;
+    else _slowFrames = 0;
+    if (_average < target * (1.0 - _initData.lowerBand)) _fastFrames++;
+    else _fastFrames = 0;
+
+    if (_slowFrames >= _initData.lowerAfter && _level > 0) {
+        changeLevel(_level - 1, "above");
+        return true;
+    }
+    if (_fastFrames >= _initData.raiseAfter && _level < _initData.levels - 1) {
+        changeLevel(_level + 1, "below");
+        return true;
+    }
+    return false;
+}
+
+QualitySettings QualityGovernor::getSettings() const
+{
+    //Linear interpolation between lowest & highest settings
+    float t = _initData.levels > 1 ? (float)_level / (_initData.levels - 1) : 1.0f;
+    const QualitySettings& lo = _initData.low;
+    const QualitySettings& hi = _initData.high;
+    QualitySettings q;
+    q.farPlane = lo.farPlane + (hi.farPlane - lo.farPlane) * t;
+    q.lodDistance = lo.lodDistance + (hi.lodDistance - lo.lodDistance) * t;
+    q.meshBudget = (int)round(lo.meshBudget + (hi.meshBudget - lo.meshBudget) * t);
+    q.uploadBudget = (int)round(lo.uploadBudget + (hi.uploadBudget - lo.uploadBudget) * t);
+    return q;
+}
+
+void QualityGovernor::changeLevel(int level, const char *reason)
+{
+    int previous = _level;
+    _level = level;
+    _slowFrames = 0;
+    _fastFrames = 0;
+    _cooldown = _initData.cooldown;
+
+    QualitySettings q = getSettings();
+    std::cout << "Quality " << previous << " -> " << level << ": average frame time "
+        << _average * 1000.0 << " ms " << reason << " target " << _initData.targetFrameTime * 1000.0
+        << " ms. Far plane " << q.farPlane << ", LOD distance " << q.lodDistance << ", mesh budget "
+        << q.meshBudget << ", upload budget " << q.uploadBudget << ".\r\n";
+}
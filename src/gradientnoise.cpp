@@ -0,0 +1,913 @@
+#include "gradientnoise.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <vector>
+#include <algorithm>
+
+#include "threadpool.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_SIMD
+#include <immintrin.h>
+#endif
+
+//Rows of output generated per fractal noise task
+#define NOISE_TILE_ROWS 16
+#define NOISE_UPSAMPLED_TILE_ROWS 32
+#define NOISE_SQRT1_2 0.70710678f
+//Gradient angles a layer draws from, PI / 100 apart
+#define NOISE_ANGLES 200
+//Most samples per cell of a multiresolution octave, & fewest pixels between them
+#define NOISE_SAMPLES_PER_CELL 8
+#define NOISE_SAMPLE_STRIDE 3
+/*Costs per pixel of upsampling a multiresolution octave, relative to evaluating
+it at every pixel & adding it: blending 4 sample rows into a pixel row, per pixel
+of a sample row interpolated across, & per sample evaluated*/
+#define NOISE_BLEND_COST 0.15f
+#define NOISE_INTERPOLATE_COST 0.35f
+#define NOISE_SAMPLE_COST 1.2f
+//Scales summed simplex corner contributions with unit gradients to about [-1, 1]
+#define SIMPLEX_SCALE 99.2f
+//Simplex lattice spacing per unit of csize, so features match seededNoise's size at the same csize
+#define SIMPLEX_SPACING 2.25f
+
+//5th order smoothstep
+float smoothstep(float x) {
+    return ((6.0 * x - 15.0) * x + 10) * x * x * x;
+}
+
+float gSqPixel(int x, int y, int size, float sinCosA[8], float norm) {
+	float v[4] = {};
+	for (int k = 0; k < 4; k++) {
+		int cx = x - (k % 2) * size;
+		int cy = y - (k < 2) * size;
+		cx = cx < 0 ? -cx : cx;
+		cy = cy < 0 ? -cy : cy;
+		v[k] = (cx * sinCosA[k+4] + cy * sinCosA[k]) / norm;
+	}
+	float top = v[0] + (v[1] - v[0]) * smoothstep((float)x/size);
+	float bottom = v[2] + (v[3] - v[2]) * smoothstep((float)x/size);
+	return top + (bottom - top) * smoothstep((float)y/size);
+}
+
+//Gradient angles of one layer of noise, on a grid of (n+1)^2 cell corners
+struct NoiseLayer {
+    int csize, n;
+    std::vector<float> sinA, cosA;
+};
+
+//Draw a layer's gradient angles from rand(), in the order gradientNoise always has
+static void makeLayer(NoiseLayer& layer, int csize, int n) {
+	int nangles = n*n + 2*n+1; //grid of gradients is size (n+1)^2
+	layer.csize = csize;
+	layer.n = n;
+	layer.sinA.resize(nangles);
+	layer.cosA.resize(nangles);
+	//rand() only picks from NOISE_ANGLES angles, so their sines & cosines are worked out once
+	static const std::vector<float> angles = []() {
+		std::vector<float> sinCos(2 * NOISE_ANGLES);
+		for (int k = 0; k < NOISE_ANGLES; k++) {
+			float angle = PI * (float)k / 100;
+			sinCos[2 * k] = sin(angle);
+			sinCos[2 * k + 1] = cos(angle);
+		}
+		return sinCos;
+	}();
+	for (int i = 0; i < nangles; i++) {
+		int k = rand() % NOISE_ANGLES;
+		layer.sinA[i] = angles[2 * k];
+		layer.cosA[i] = angles[2 * k + 1]; //fill up grid of gradient angles
+	}
+}
+
+//Reference path, one pixel at a time
+static void noiseRowsScalar(float *out, const NoiseLayer& layer, int width, int y0, int y1) {
+	int csize = layer.csize, n = layer.n;
+    float norm = 2.0 * (float)csize / sqrt(2); //normalisation term
+	for (int y = y0; y < y1; y++)
+	for (int x = 0; x < width; x++) {
+		int gridX = x / csize;
+		int gridY = y / csize; //angle grid coords
+		//get angles for 4 corners of current grid coord
+		float angles[8] = {};
+		for (int j = 0; j < 4; j++) {
+			angles[j] = layer.sinA[(gridY + j / 2) * n + (gridX + j % 2)];
+			angles[j+4] = layer.cosA[(gridY + j / 2) * n + (gridX + j % 2)];
+		}
+		out[(y - y0) * width + x] = (gSqPixel(x % csize, y % csize, csize, angles, norm) + 1) / 2;
+	}
+}
+
+/*One row of output, with everything that only depends on the column laid out per
+column. Corner k's x distance is cx02 for corners 0 & 2 and cx13 for 1 & 3, its
+y distance is the same for the whole row.
+*/
+struct NoiseRow {
+    const float *cx02, *cx13, *fadeX;
+    float *cosA[4], *sinA[4]; //gradients of the column's cell corners
+    int width;
+    float norm;
+};
+
+typedef void (*NoiseRowKernel)(float *out, const NoiseRow& row, float cy01, float cy23, float fadeY);
+
+//Single pixel of a row, same operations as gSqPixel
+static inline float noisePixel(const NoiseRow& r, int i, float cy01, float cy23, float fadeY) {
+    float v0 = (r.cx02[i] * r.cosA[0][i] + cy01 * r.sinA[0][i]) / r.norm;
+    float v1 = (r.cx13[i] * r.cosA[1][i] + cy01 * r.sinA[1][i]) / r.norm;
+    float v2 = (r.cx02[i] * r.cosA[2][i] + cy23 * r.sinA[2][i]) / r.norm;
+    float v3 = (r.cx13[i] * r.cosA[3][i] + cy23 * r.sinA[3][i]) / r.norm;
+    float top = v0 + (v1 - v0) * r.fadeX[i];
+    float bottom = v2 + (v3 - v2) * r.fadeX[i];
+    return (top + (bottom - top) * fadeY + 1) / 2;
+}
+
+static void noiseRowScalar(float *out, const NoiseRow& r, float cy01, float cy23, float fadeY) {
+    for (int i = 0; i < r.width; i++) out[i] = noisePixel(r, i, cy01, cy23, fadeY);
+}
+
+#ifdef NOISE_SIMD
+__attribute__((target("sse4.1")))
+static void noiseRowSSE41(float *out, const NoiseRow& r, float cy01, float cy23, float fadeY) {
+    __m128 norm = _mm_set1_ps(r.norm), y01 = _mm_set1_ps(cy01), y23 = _mm_set1_ps(cy23);
+    __m128 fy = _mm_set1_ps(fadeY), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    int i = 0;
+    for (; i + 4 <= r.width; i += 4) {
+        __m128 x02 = _mm_loadu_ps(r.cx02 + i), x13 = _mm_loadu_ps(r.cx13 + i), fx = _mm_loadu_ps(r.fadeX + i);
+        __m128 v0 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(x02, _mm_loadu_ps(r.cosA[0] + i)), _mm_mul_ps(y01, _mm_loadu_ps(r.sinA[0] + i))), norm);
+        __m128 v1 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(x13, _mm_loadu_ps(r.cosA[1] + i)), _mm_mul_ps(y01, _mm_loadu_ps(r.sinA[1] + i))), norm);
+        __m128 v2 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(x02, _mm_loadu_ps(r.cosA[2] + i)), _mm_mul_ps(y23, _mm_loadu_ps(r.sinA[2] + i))), norm);
+        __m128 v3 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(x13, _mm_loadu_ps(r.cosA[3] + i)), _mm_mul_ps(y23, _mm_loadu_ps(r.sinA[3] + i))), norm);
+        __m128 top = _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), fx));
+        __m128 bottom = _mm_add_ps(v2, _mm_mul_ps(_mm_sub_ps(v3, v2), fx));
+        __m128 value = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+        _mm_storeu_ps(out + i, _mm_div_ps(_mm_add_ps(value, one), two));
+    }
+    for (; i < r.width; i++) out[i] = noisePixel(r, i, cy01, cy23, fadeY);
+}
+
+__attribute__((target("avx2")))
+static void noiseRowAVX2(float *out, const NoiseRow& r, float cy01, float cy23, float fadeY) {
+    __m256 norm = _mm256_set1_ps(r.norm), y01 = _mm256_set1_ps(cy01), y23 = _mm256_set1_ps(cy23);
+    __m256 fy = _mm256_set1_ps(fadeY), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    int i = 0;
+    for (; i + 8 <= r.width; i += 8) {
+        __m256 x02 = _mm256_loadu_ps(r.cx02 + i), x13 = _mm256_loadu_ps(r.cx13 + i), fx = _mm256_loadu_ps(r.fadeX + i);
+        __m256 v0 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(x02, _mm256_loadu_ps(r.cosA[0] + i)), _mm256_mul_ps(y01, _mm256_loadu_ps(r.sinA[0] + i))), norm);
+        __m256 v1 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(x13, _mm256_loadu_ps(r.cosA[1] + i)), _mm256_mul_ps(y01, _mm256_loadu_ps(r.sinA[1] + i))), norm);
+        __m256 v2 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(x02, _mm256_loadu_ps(r.cosA[2] + i)), _mm256_mul_ps(y23, _mm256_loadu_ps(r.sinA[2] + i))), norm);
+        __m256 v3 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(x13, _mm256_loadu_ps(r.cosA[3] + i)), _mm256_mul_ps(y23, _mm256_loadu_ps(r.sinA[3] + i))), norm);
+        __m256 top = _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), fx));
+        __m256 bottom = _mm256_add_ps(v2, _mm256_mul_ps(_mm256_sub_ps(v3, v2), fx));
+        __m256 value = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy));
+        _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_add_ps(value, one), two));
+    }
+    for (; i < r.width; i++) out[i] = noisePixel(r, i, cy01, cy23, fadeY);
+}
+
+__attribute__((target("avx512f")))
+static void noiseRowAVX512(float *out, const NoiseRow& r, float cy01, float cy23, float fadeY) {
+    __m512 norm = _mm512_set1_ps(r.norm), y01 = _mm512_set1_ps(cy01), y23 = _mm512_set1_ps(cy23);
+    __m512 fy = _mm512_set1_ps(fadeY), one = _mm512_set1_ps(1.0f), two = _mm512_set1_ps(2.0f);
+    //The tail is done with a partial mask rather than one pixel at a time
+    for (int i = 0; i < r.width; i += 16) {
+        __mmask16 m = r.width - i >= 16 ? 0xFFFF : (__mmask16)((1u << (r.width - i)) - 1);
+        __m512 x02 = _mm512_maskz_loadu_ps(m, r.cx02 + i), x13 = _mm512_maskz_loadu_ps(m, r.cx13 + i);
+        __m512 fx = _mm512_maskz_loadu_ps(m, r.fadeX + i);
+        __m512 v0 = _mm512_div_ps(_mm512_add_ps(_mm512_mul_ps(x02, _mm512_maskz_loadu_ps(m, r.cosA[0] + i)), _mm512_mul_ps(y01, _mm512_maskz_loadu_ps(m, r.sinA[0] + i))), norm);
+        __m512 v1 = _mm512_div_ps(_mm512_add_ps(_mm512_mul_ps(x13, _mm512_maskz_loadu_ps(m, r.cosA[1] + i)), _mm512_mul_ps(y01, _mm512_maskz_loadu_ps(m, r.sinA[1] + i))), norm);
+        __m512 v2 = _mm512_div_ps(_mm512_add_ps(_mm512_mul_ps(x02, _mm512_maskz_loadu_ps(m, r.cosA[2] + i)), _mm512_mul_ps(y23, _mm512_maskz_loadu_ps(m, r.sinA[2] + i))), norm);
+        __m512 v3 = _mm512_div_ps(_mm512_add_ps(_mm512_mul_ps(x13, _mm512_maskz_loadu_ps(m, r.cosA[3] + i)), _mm512_mul_ps(y23, _mm512_maskz_loadu_ps(m, r.sinA[3] + i))), norm);
+        __m512 top = _mm512_add_ps(v0, _mm512_mul_ps(_mm512_sub_ps(v1, v0), fx));
+        __m512 bottom = _mm512_add_ps(v2, _mm512_mul_ps(_mm512_sub_ps(v3, v2), fx));
+        __m512 value = _mm512_add_ps(top, _mm512_mul_ps(_mm512_sub_ps(bottom, top), fy));
+        _mm512_mask_storeu_ps(out + i, m, _mm512_div_ps(_mm512_add_ps(value, one), two));
+    }
+}
+#endif
+
+/*Add a weighted sum of 4 rows to out, for interpolating between sample rows of a
+multiresolution octave. Summed in the same order by every kernel.
+*/
+typedef void (*UpsampleRowKernel)(float *out, const float *rows[4], const float w[4], int width);
+
+static void upsampleRowScalar(float *out, const float *rows[4], const float w[4], int width) {
+    for (int i = 0; i < width; i++)
+        out[i] += w[0] * rows[0][i] + w[1] * rows[1][i] + w[2] * rows[2][i] + w[3] * rows[3][i];
+}
+
+#ifdef NOISE_SIMD
+__attribute__((target("sse4.1")))
+static void upsampleRowSSE41(float *out, const float *rows[4], const float w[4], int width) {
+    __m128 w0 = _mm_set1_ps(w[0]), w1 = _mm_set1_ps(w[1]), w2 = _mm_set1_ps(w[2]), w3 = _mm_set1_ps(w[3]);
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_mul_ps(w0, _mm_loadu_ps(rows[0] + i)), _mm_mul_ps(w1, _mm_loadu_ps(rows[1] + i)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(w2, _mm_loadu_ps(rows[2] + i)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(w3, _mm_loadu_ps(rows[3] + i)));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), sum));
+    }
+    for (; i < width; i++)
+        out[i] += w[0] * rows[0][i] + w[1] * rows[1][i] + w[2] * rows[2][i] + w[3] * rows[3][i];
+}
+
+__attribute__((target("avx2")))
+static void upsampleRowAVX2(float *out, const float *rows[4], const float w[4], int width) {
+    __m256 w0 = _mm256_set1_ps(w[0]), w1 = _mm256_set1_ps(w[1]), w2 = _mm256_set1_ps(w[2]), w3 = _mm256_set1_ps(w[3]);
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_mul_ps(w0, _mm256_loadu_ps(rows[0] + i)), _mm256_mul_ps(w1, _mm256_loadu_ps(rows[1] + i)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(w2, _mm256_loadu_ps(rows[2] + i)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(w3, _mm256_loadu_ps(rows[3] + i)));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), sum));
+    }
+    for (; i < width; i++)
+        out[i] += w[0] * rows[0][i] + w[1] * rows[1][i] + w[2] * rows[2][i] + w[3] * rows[3][i];
+}
+
+__attribute__((target("avx512f")))
+static void upsampleRowAVX512(float *out, const float *rows[4], const float w[4], int width) {
+    __m512 w0 = _mm512_set1_ps(w[0]), w1 = _mm512_set1_ps(w[1]), w2 = _mm512_set1_ps(w[2]), w3 = _mm512_set1_ps(w[3]);
+    for (int i = 0; i < width; i += 16) {
+        __mmask16 m = width - i >= 16 ? 0xFFFF : (__mmask16)((1u << (width - i)) - 1);
+        __m512 sum = _mm512_add_ps(_mm512_mul_ps(w0, _mm512_maskz_loadu_ps(m, rows[0] + i)),
+            _mm512_mul_ps(w1, _mm512_maskz_loadu_ps(m, rows[1] + i)));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(w2, _mm512_maskz_loadu_ps(m, rows[2] + i)));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(w3, _mm512_maskz_loadu_ps(m, rows[3] + i)));
+        _mm512_mask_storeu_ps(out + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, out + i), sum));
+    }
+}
+#endif
+
+/*Interpolate a row of samples out to width pixels, each pixel from the 4
+samples from first[x] with weights 4x to 4x + 3. Summed as (w0 s0 + w1 s1) +
+(w2 s2 + w3 s3) by every kernel, the order horizontal adds give.
+*/
+typedef void (*InterpolateRowKernel)(float *out, const float *samples, const int *first, const float *weights,
+    int width);
+
+static inline float interpolatePixel(const float *s, const float *w) {
+    return (w[0] * s[0] + w[1] * s[1]) + (w[2] * s[2] + w[3] * s[3]);
+}
+
+static void interpolateRowScalar(float *out, const float *samples, const int *first, const float *weights,
+        int width) {
+    for (int x = 0; x < width; x++) out[x] = interpolatePixel(samples + first[x], weights + 4 * x);
+}
+
+#ifdef NOISE_SIMD
+__attribute__((target("sse4.1")))
+static void interpolateRowSSE41(float *out, const float *samples, const int *first, const float *weights,
+        int width) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128 p[4];
+        for (int j = 0; j < 4; j++)
+            p[j] = _mm_mul_ps(_mm_loadu_ps(samples + first[x + j]), _mm_loadu_ps(weights + 4 * (x + j)));
+        _mm_storeu_ps(out + x, _mm_hadd_ps(_mm_hadd_ps(p[0], p[1]), _mm_hadd_ps(p[2], p[3])));
+    }
+    for (; x < width; x++) out[x] = interpolatePixel(samples + first[x], weights + 4 * x);
+}
+
+//Pixels x & x + 4 share a register, as 256 bit horizontal adds work within 128 bit halves
+__attribute__((target("avx2")))
+static void interpolateRowAVX2(float *out, const float *samples, const int *first, const float *weights,
+        int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256 p[4];
+        for (int j = 0; j < 4; j++) {
+            __m256 s = _mm256_set_m128(_mm_loadu_ps(samples + first[x + j + 4]), _mm_loadu_ps(samples + first[x + j]));
+            __m256 w = _mm256_set_m128(_mm_loadu_ps(weights + 4 * (x + j + 4)), _mm_loadu_ps(weights + 4 * (x + j)));
+            p[j] = _mm256_mul_ps(s, w);
+        }
+        _mm256_storeu_ps(out + x, _mm256_hadd_ps(_mm256_hadd_ps(p[0], p[1]), _mm256_hadd_ps(p[2], p[3])));
+    }
+    for (; x < width; x++) out[x] = interpolatePixel(samples + first[x], weights + 4 * x);
+}
+#endif
+
+//Point a row's arrays into columns, sized for width columns
+static NoiseRow rowStorage(std::vector<float>& columns, int width, int csize) {
+    columns.resize(11 * width);
+    float *cx02 = columns.data(), *cx13 = cx02 + width, *fadeX = cx13 + width;
+    NoiseRow row = {cx02, cx13, fadeX, {}, {}, width, (float)(2.0 * (float)csize / sqrt(2))};
+    for (int k = 0; k < 4; k++) {
+        row.cosA[k] = fadeX + width * (1 + k);
+        row.sinA[k] = fadeX + width * (5 + k);
+    }
+    return row;
+}
+
+//Lay out distances & fades for columns x0 to x0 + width, gradients are filled in per row of cells
+static NoiseRow layoutRow(std::vector<float>& columns, int width, int csize, int x0) {
+    NoiseRow row = rowStorage(columns, width, csize);
+    float *cx02 = columns.data(), *cx13 = cx02 + width, *fadeX = cx13 + width;
+    for (int x = 0; x < width; x++) {
+        int px = ((x0 + x) % csize + csize) % csize;
+        cx02[x] = px;
+        cx13[x] = csize - px;
+        fadeX[x] = smoothstep((float)px/csize);
+    }
+    return row;
+}
+
+/*Lay out the corner gradients of a row of cells for the row's columns, which are
+pixels or, given their positions, samples. Gradients are constant across a cell.
+*/
+static void layoutGradients(NoiseRow& row, const NoiseLayer& layer, int gridY, const int *positions = nullptr) {
+    int csize = layer.csize, n = layer.n;
+    for (int x = 0, gridX = 0; x < row.width; gridX++) {
+        int end = positions ? x : std::min(x + csize, row.width);
+        if (positions) while (end < row.width && positions[end] < (gridX + 1) * csize) end++;
+        float cosA[4], sinA[4];
+        for (int k = 0; k < 4; k++) {
+            int corner = (gridY + k / 2) * n + (gridX + k % 2);
+            cosA[k] = layer.cosA[corner];
+            sinA[k] = layer.sinA[corner];
+        }
+        for (; x < end; x++) {
+            for (int k = 0; k < 4; k++) {
+                row.cosA[k][x] = cosA[k];
+                row.sinA[k][x] = sinA[k];
+            }
+        }
+    }
+}
+
+/*Row by row version of noiseRowsScalar. Column distances & fades repeat every
+cell so are computed once, corner gradients are laid out per column once per row
+of cells, then every row of pixels in those cells is a straight pass.
+*/
+static void noiseRowsSimd(float *out, const NoiseLayer& layer, int width, int y0, int y1, std::vector<float>& columns,
+        NoiseRowKernel kernel) {
+    int csize = layer.csize;
+    NoiseRow row = layoutRow(columns, width, csize, 0);
+    for (int gridY = y0 / csize; gridY * csize < y1; gridY++) {
+        layoutGradients(row, layer, gridY);
+        for (int y = std::max(gridY * csize, y0); y < std::min((gridY + 1) * csize, y1); y++) {
+            int py = y - gridY * csize;
+            kernel(out + (y - y0) * width, row, csize - py, py, smoothstep((float)py/csize));
+        }
+    }
+}
+
+//Kernels for the instruction set bound by setSimdIsa, scalar until then
+static SimdIsa noiseIsa = SimdIsa::Scalar;
+static NoiseRowKernel noiseRowKernel = noiseRowScalar;
+static UpsampleRowKernel upsampleRowKernel = upsampleRowScalar;
+static InterpolateRowKernel interpolateRowKernel = interpolateRowScalar;
+
+void bindNoiseKernels(SimdIsa isa) {
+	noiseIsa = isa;
+	switch (isa)
+	{
+#ifdef NOISE_SIMD
+	case SimdIsa::SSE41:
+		noiseRowKernel = noiseRowSSE41; upsampleRowKernel = upsampleRowSSE41; interpolateRowKernel = interpolateRowSSE41;
+		break;
+	case SimdIsa::AVX2:
+		noiseRowKernel = noiseRowAVX2; upsampleRowKernel = upsampleRowAVX2; interpolateRowKernel = interpolateRowAVX2;
+		break;
+	//Gathering 4 samples per pixel gains nothing from wider registers
+	case SimdIsa::AVX512:
+		noiseRowKernel = noiseRowAVX512; upsampleRowKernel = upsampleRowAVX512; interpolateRowKernel = interpolateRowAVX2;
+		break;
+#endif
+	default: noiseRowKernel = noiseRowScalar; upsampleRowKernel = upsampleRowScalar; interpolateRowKernel = interpolateRowScalar;
+	}
+}
+
+//Rows [y0, y1) of a layer clipped to width columns, out points at row y0
+static void noiseRows(float *out, const NoiseLayer& layer, int width, int y0, int y1, std::vector<float>& columns) {
+	if (noiseIsa == SimdIsa::Scalar) noiseRowsScalar(out, layer, width, y0, y1);
+	else noiseRowsSimd(out, layer, width, y0, y1, columns, noiseRowKernel);
+}
+
+void gradientNoise(float *out, int csize, int n, int outXDim, int outYDim) {
+	NoiseLayer layer;
+	makeLayer(layer, csize, n);
+	int width = std::min(outXDim, csize * n);
+	int height = std::min(outYDim, csize * n);
+	if (width <= 0) return;
+	std::vector<float> columns;
+	noiseRows(out, layer, width, 0, height, columns);
+}
+
+//Scratch reused by one thread across tiles & octaves
+struct NoiseScratch {
+    std::vector<float> octave, columns;
+    //Multiresolution octaves: a sample row, & per octave its tile's sample rows or its column layout
+    std::vector<float> samples;
+    std::vector<std::vector<float>> coarse, layouts;
+    std::vector<NoiseRow> rows;
+    std::vector<int> firstRows, gradientRows;
+};
+
+/*Sample positions of a multiresolution octave along either axis & how to
+interpolate between them. Noise is smooth within a cell but has a kink at cell
+edges, so every cell is sampled at both edges & perCell - 1 points between, &
+each pixel is a polynomial through the 4 nearest samples of its own cell, or all
+of them if it has fewer. None fall outside the layer, a partial last cell ends
+at the last pixel. Taps of a pixel are consecutive, from first.
+*/
+struct OctaveSamples {
+    std::vector<int> positions, first;
+    std::vector<float> weights;
+};
+
+static void makeOctaveSamples(OctaveSamples& samples, int size, int csize, int perCell) {
+    samples.positions.clear();
+    for (int cell = 0; cell * csize < size - 1; cell++) {
+        for (int j = 0; j < perCell; j++) {
+            int p = cell * csize + (j * csize + perCell / 2) / perCell;
+            if (p < size - 1) samples.positions.push_back(p);
+        }
+    }
+    samples.positions.push_back(size - 1);
+
+    samples.first.resize(size);
+    samples.weights.resize(4 * size);
+    int k = 0;
+    for (int x = 0; x < size; x++) {
+        while (k + 1 < (int)samples.positions.size() - 1 && samples.positions[k + 1] <= x) k++;
+        //Samples of the cell, both edges included
+        int cellStart = x / csize * csize, cellEnd = std::min(cellStart + csize, size - 1);
+        int lo = k, hi = k;
+        while (lo > 0 && samples.positions[lo - 1] >= cellStart) lo--;
+        while (hi + 1 < (int)samples.positions.size() && samples.positions[hi + 1] <= cellEnd) hi++;
+        //4 consecutive taps around the pixel within the cell, fewer if the cell has fewer
+        int count = std::min(hi - lo + 1, 4);
+        int first = std::min(std::max(k - 1, lo), hi - count + 1);
+        samples.first[x] = first;
+        for (int j = 0; j < 4; j++) {
+            //Lagrange weights, taps past count have none
+            float w = 0.0f;
+            if (j < count) {
+                w = 1.0f;
+                for (int m = 0; m < count; m++) {
+                    if (m == j) continue;
+                    w *= (float)(x - samples.positions[first + m]) / (samples.positions[first + j] - samples.positions[first + m]);
+                }
+            }
+            samples.weights[4 * x + j] = w;
+        }
+    }
+}
+
+/*Estimated cost per pixel of an octave upsampled from perCell samples per
+cell, relative to evaluating it at every pixel, both with the vectorised
+kernels. A tile evaluates a sample row every csize / perCell rows & up to 3
+more for its taps, interpolates each across the tile's width, then blends 4
+sample rows into every pixel row.
+*/
+static float upsampledCost(int csize, int perCell, int tileRows) {
+    float stride = (float)csize / perCell;
+    float rows = 1.0f / stride + 3.0f / tileRows;
+    return NOISE_BLEND_COST + rows * (NOISE_INTERPOLATE_COST + NOISE_SAMPLE_COST / stride);
+}
+
+/*Sample rows of a layer that the taps of rows [y0, y1) reach, each evaluated at
+the sample columns & interpolated across width pixels into coarse. Sample
+columns are laid out once, their gradients again only when the sample rows
+enter the next row of cells. Returns the first sample row.
+*/
+static int sampleRows(std::vector<float>& coarse, const NoiseLayer& layer, const OctaveSamples& samples, int width,
+        int y0, int y1, NoiseScratch& s) {
+    int csize = layer.csize;
+    int count = samples.positions.size();
+    int first = samples.first[y0], last = std::min(samples.first[y1 - 1] + 3, count - 1);
+    NoiseRow row = rowStorage(s.columns, count, csize);
+    float *cx02 = s.columns.data(), *cx13 = cx02 + count, *fadeX = cx13 + count;
+    for (int i = 0; i < count; i++) {
+        int px = samples.positions[i] % csize;
+        cx02[i] = px;
+        cx13[i] = csize - px;
+        fadeX[i] = smoothstep((float)px/csize);
+    }
+    //Taps past a pixel's count read past the last sample, with no weight
+    s.samples.assign(count + 3, 0.0f);
+    coarse.resize((last - first + 1) * width);
+    int gradientsY = -1;
+    for (int k = first; k <= last; k++) {
+        int y = samples.positions[k], gridY = y / csize, py = y % csize;
+        if (gridY != gradientsY) {
+            layoutGradients(row, layer, gridY, samples.positions.data());
+            gradientsY = gridY;
+        }
+        noiseRowKernel(s.samples.data(), row, csize - py, py, smoothstep((float)py/csize));
+        interpolateRowKernel(&coarse[(k - first) * width], s.samples.data(), samples.first.data(),
+            samples.weights.data(), width);
+    }
+    return first;
+}
+
+/*Rows [y0, y1) of multiresolution fractal noise. Upsampled octaves' sample rows
+are made for the tile first, then each pixel row adds up every octave in turn
+while it's in cache: upsampled ones blended down their sample rows, others
+evaluated at every pixel with columns laid out once per tile. Summed in float.
+*/
+static void multiresolutionRows(float *out, const std::vector<NoiseLayer>& layers, const std::vector<double>& weights,
+        const std::vector<OctaveSamples>& samples, float norm, int width, int y0, int y1, NoiseScratch& s) {
+    size_t octaves = layers.size();
+    s.coarse.resize(octaves);
+    s.layouts.resize(octaves);
+    s.rows.resize(octaves);
+    s.firstRows.assign(octaves, 0);
+    s.gradientRows.assign(octaves, -1);
+    for (size_t i = 0; i < octaves; i++) {
+        if (!samples[i].positions.empty()) s.firstRows[i] = sampleRows(s.coarse[i], layers[i], samples[i], width, y0, y1, s);
+        else s.rows[i] = layoutRow(s.layouts[i], width, layers[i].csize, 0);
+    }
+    s.octave.resize(width);
+    for (int y = y0; y < y1; y++) {
+        float *pixels = out + (y - y0) * width;
+        std::fill_n(pixels, width, 0.0f);
+        for (size_t i = 0; i < octaves; i++) {
+            const NoiseLayer& layer = layers[i];
+            if (!samples[i].positions.empty()) {
+                const OctaveSamples& octave = samples[i];
+                int last = std::min(octave.first[y1 - 1] + 3, (int)octave.positions.size() - 1);
+                const float *rows[4];
+                float w[4];
+                for (int j = 0; j < 4; j++) {
+                    //Taps past the last sample row have no weight, any row will do
+                    rows[j] = &s.coarse[i][(std::min(octave.first[y] + j, last) - s.firstRows[i]) * width];
+                    w[j] = octave.weights[4 * y + j] * (float)weights[i];
+                }
+                upsampleRowKernel(pixels, rows, w, width);
+                continue;
+            }
+            int csize = layer.csize, gridY = y / csize, py = y % csize;
+            NoiseRow& row = s.rows[i];
+            if (gridY != s.gradientRows[i]) {
+                layoutGradients(row, layer, gridY);
+                s.gradientRows[i] = gridY;
+            }
+            noiseRowKernel(s.octave.data(), row, csize - py, py, smoothstep((float)py/csize));
+            float weight = weights[i];
+            for (int x = 0; x < width; x++) pixels[x] += s.octave[x] * weight;
+        }
+        for (int x = 0; x < width; x++) pixels[x] /= norm;
+    }
+}
+
+/*Angles for every octave are drawn up front in the same order as ever, after
+which each tile of rows is independent. A tile accumulates its octaves in order
+& normalises while adding the last, so results are the same for any number of
+threads, & the same as generating each octave in full.
+*/
+static void fractalNoiseTiles(float *out, int csize, int n, int octaves, float lacunarity, float persistence,
+        ThreadPool *pool, OctaveSampling sampling) {
+	int size = csize * n;
+	std::vector<NoiseLayer> layers(std::max(octaves, 1));
+	std::vector<double> weights(layers.size(), 1.0);
+	makeLayer(layers[0], csize, n); //initial noise layer
+	float norm = 1;
+	for (int i = 0; i < octaves - 1; i++) {
+		int newCellSize = (int)round((float)csize / pow(lacunarity, (i + 1)));
+		makeLayer(layers[i + 1], newCellSize, size / newCellSize + 1);
+		weights[i + 1] = pow(persistence, i + 1);
+		norm += weights[i + 1];
+	}
+	//Taller tiles evaluate fewer sample rows twice, output doesn't depend on the tiling
+	//A lone octave has nothing to add up, so isn't any cheaper upsampled
+	if (layers.size() == 1) sampling = OctaveSampling::FullResolution;
+	int tileRows = sampling == OctaveSampling::Multiresolution ? NOISE_UPSAMPLED_TILE_ROWS : NOISE_TILE_ROWS;
+	/*Octaves are sampled NOISE_SAMPLE_STRIDE pixels apart or more, up to
+	NOISE_SAMPLES_PER_CELL times per cell. Ones too fine for 2 samples per cell,
+	or that upsampling wouldn't make cheaper, are still evaluated at every pixel.*/
+	std::vector<OctaveSamples> samples(layers.size());
+	for (size_t i = 0; i < layers.size(); i++) {
+		int perCell = std::min(NOISE_SAMPLES_PER_CELL, layers[i].csize / NOISE_SAMPLE_STRIDE);
+		if (sampling == OctaveSampling::Multiresolution && perCell >= 2
+				&& upsampledCost(layers[i].csize, perCell, tileRows) < 1.0f)
+			makeOctaveSamples(samples[i], size, layers[i].csize, perCell);
+	}
+	int tiles = (size + tileRows - 1) / tileRows;
+	std::vector<NoiseScratch> scratch(pool ? pool->getThreadCount() : 1);
+	auto tile = [&](int task, int worker) {
+		int y0 = task * tileRows;
+		int y1 = std::min(y0 + tileRows, size);
+		float *rows = out + y0 * size;
+		int count = (y1 - y0) * size;
+		NoiseScratch& s = scratch[worker];
+		if (sampling == OctaveSampling::Multiresolution) {
+			multiresolutionRows(rows, layers, weights, samples, norm, size, y0, y1, s);
+			return;
+		}
+		s.octave.resize(count);
+		for (size_t i = 0; i < layers.size(); i++) {
+			if (i == 0) {
+				noiseRows(rows, layers[0], size, y0, y1, s.columns);
+				continue;
+			}
+			noiseRows(s.octave.data(), layers[i], size, y0, y1, s.columns);
+			double weight = weights[i];
+			if (i + 1 < layers.size()) {
+				for (int j = 0; j < count; j++) rows[j] += s.octave[j] * weight;
+			}
+			else {
+				for (int j = 0; j < count; j++) rows[j] = (float)(rows[j] + s.octave[j] * weight) / norm;
+			}
+		}
+	};
+	if (pool) pool->parallelFor(tiles, tile);
+	else for (int i = 0; i < tiles; i++) tile(i, 0);
+}
+
+void fractalNoise(float *out, int csize, int n, int octaves, float lacunarity, float persistence,
+        OctaveSampling sampling) {
+	fractalNoiseTiles(out, csize, n, octaves, lacunarity, persistence, NULL, sampling);
+}
+
+void fractalNoise(float *out, int csize, int n, int octaves, float lacunarity, float persistence, ThreadPool& pool,
+        OctaveSampling sampling) {
+	fractalNoiseTiles(out, csize, n, octaves, lacunarity, persistence, &pool, sampling);
+}
+
+//Angles hashed gradients are picked from, the same 200 gradientNoise draws from
+struct AngleTable {
+    float sinA[200], cosA[200];
+    AngleTable() {
+        for (int i = 0; i < 200; i++) {
+            float angle = PI * (float)i / 100;
+            sinA[i] = sin(angle);
+            cosA[i] = cos(angle);
+        }
+    }
+};
+
+static const AngleTable& angleTable() {
+    static AngleTable table;
+    return table;
+}
+
+uint32_t latticeHash(uint32_t seed, int x, int z) {
+    //Each coordinate is mixed in with a full avalanche, so neighbouring lattice points are unrelated
+    uint32_t h = seed;
+    for (uint32_t v : {(uint32_t)x, (uint32_t)z}) {
+        h ^= v + 0x9E3779B9u + (h << 6) + (h >> 2);
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+    }
+    return h;
+}
+
+static inline float clamp01(float x) {
+    return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+}
+
+//floorf without SSE4.1 is a library call
+static inline int fastFloor(float x) {
+    int i = (int)x;
+    return i - (x < i);
+}
+
+static inline int floorDiv(int a, int b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+//One layer of hashed noise over a window, row by row as noiseRowsSimd
+static void hashedNoiseRows(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed,
+        std::vector<float>& columns) {
+    NoiseRowKernel kernel = noiseRowKernel;
+    const AngleTable& angles = angleTable();
+    NoiseRow row = layoutRow(columns, width, csize, x0);
+    for (int gridZ = floorDiv(z0, csize); gridZ * csize < z0 + height; gridZ++) {
+        //Corner gradients are hashed once per cell & spread over its columns
+        int cell = INT_MIN;
+        int corners[4] = {};
+        for (int x = 0; x < width; x++) {
+            int gridX = floorDiv(x0 + x, csize);
+            if (gridX != cell) {
+                cell = gridX;
+                for (int k = 0; k < 4; k++) corners[k] = latticeHash(seed, gridX + k % 2, gridZ + k / 2) % 200;
+            }
+            for (int k = 0; k < 4; k++) {
+                row.cosA[k][x] = angles.cosA[corners[k]];
+                row.sinA[k][x] = angles.sinA[corners[k]];
+            }
+        }
+        for (int z = std::max(gridZ * csize, z0); z < std::min((gridZ + 1) * csize, z0 + height); z++) {
+            int pz = z - gridZ * csize;
+            kernel(out + (z - z0) * width, row, csize - pz, pz, smoothstep((float)pz/csize));
+        }
+    }
+}
+
+/*2D simplex noise over a window. Points are skewed onto a lattice of triangles,
+each sample sums radial falloffs from the 3 corners of its triangle rather than
+interpolating 4 square corners. Gradients of every lattice point the window
+touches are hashed once into gradients, as cos & sin pairs.
+*/
+static void simplexRows(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed,
+        std::vector<float>& gradients) {
+    const float F2 = 0.5f * (sqrtf(3.0f) - 1.0f);
+    const float G2 = (3.0f - sqrtf(3.0f)) / 6.0f;
+    const AngleTable& angles = angleTable();
+    float scale = 1.0f / (csize * SIMPLEX_SPACING);
+    //Skewed lattice cell of a point, increasing in both coordinates
+    auto skewedCell = [&](int x, int z, int& i, int& j) {
+        float xin = x * scale, zin = z * scale;
+        float skew = (xin + zin) * F2;
+        i = fastFloor(xin + skew);
+        j = fastFloor(zin + skew);
+    };
+    int iMin, jMin, iMax, jMax;
+    skewedCell(x0, z0, iMin, jMin);
+    skewedCell(x0 + width - 1, z0 + height - 1, iMax, jMax);
+    int stride = iMax - iMin + 2;
+    gradients.resize(2 * stride * (jMax - jMin + 2));
+    for (int j = jMin; j <= jMax + 1; j++) {
+        for (int i = iMin; i <= iMax + 1; i++) {
+            int g = latticeHash(seed, i, j) % 200;
+            float *gradient = &gradients[2 * ((j - jMin) * stride + i - iMin)];
+            gradient[0] = angles.cosA[g];
+            gradient[1] = angles.sinA[g];
+        }
+    }
+
+    for (int z = 0; z < height; z++) {
+        float zin = (z0 + z) * scale;
+        for (int x = 0; x < width; x++) {
+            float xin = (x0 + x) * scale;
+            //Skew to find the containing triangle, then unskew its first corner
+            float skew = (xin + zin) * F2;
+            int i = fastFloor(xin + skew), j = fastFloor(zin + skew);
+            float unskew = (i + j) * G2;
+            float dx[3], dz[3];
+            dx[0] = xin - (i - unskew);
+            dz[0] = zin - (j - unskew);
+            //Upper or lower triangle of the skewed square
+            int i1 = dx[0] > dz[0], j1 = 1 - i1;
+            dx[1] = dx[0] - i1 + G2;
+            dz[1] = dz[0] - j1 + G2;
+            dx[2] = dx[0] - 1.0f + 2.0f * G2;
+            dz[2] = dz[0] - 1.0f + 2.0f * G2;
+            const float *corner = &gradients[2 * ((j - jMin) * stride + i - iMin)];
+            const float *corners[3] = {corner, corner + 2 * (i1 + j1 * stride), corner + 2 * (stride + 1)};
+
+            float value = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                //Clamped rather than skipped, a branch here mispredicts often
+                float t = std::max(0.5f - dx[k] * dx[k] - dz[k] * dz[k], 0.0f);
+                t *= t;
+                value += t * t * (corners[k][0] * dx[k] + corners[k][1] * dz[k]);
+            }
+            out[z * width + x] = clamp01(value * SIMPLEX_SCALE * 0.5f + 0.5f);
+        }
+    }
+}
+
+//Evaluate one layer of the chosen lattice
+static void latticeRows(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed,
+        NoiseLattice lattice, std::vector<float>& columns) {
+    if (lattice == NoiseLattice::Simplex) simplexRows(out, x0, z0, width, height, csize, seed, columns);
+    else hashedNoiseRows(out, x0, z0, width, height, csize, seed, columns);
+}
+
+void simplexNoise(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed) {
+    if (width <= 0 || height <= 0) return;
+    std::vector<float> gradients;
+    simplexRows(out, x0, z0, width, height, csize, seed, gradients);
+}
+
+void seededNoise(float *out, int x0, int z0, int width, int height, int csize, uint32_t seed) {
+    if (width <= 0 || height <= 0) return;
+    std::vector<float> columns;
+    hashedNoiseRows(out, x0, z0, width, height, csize, seed, columns);
+}
+
+void seededFractalNoise(float *out, int x0, int z0, int width, int height, int csize, int octaves,
+        float lacunarity, float persistence, uint32_t seed, NoiseLattice lattice) {
+    if (width <= 0 || height <= 0) return;
+    NoiseScratch scratch;
+    latticeRows(out, x0, z0, width, height, csize, seed, lattice, scratch.columns);
+    if (octaves <= 1) return;
+
+    //Weights & normalisation as fractalNoise, the last octave is added & normalised in one pass
+    float norm = 1;
+    for (int i = 1; i < octaves; i++) norm += pow(persistence, i);
+    int count = width * height;
+    scratch.octave.resize(count);
+    for (int i = 1; i < octaves; i++) {
+        int cellSize = std::max((int)round((float)csize / pow(lacunarity, i)), 1);
+        latticeRows(scratch.octave.data(), x0, z0, width, height, cellSize, latticeHash(seed, i, 0), lattice, scratch.columns);
+        double weight = pow(persistence, i);
+        if (i + 1 < octaves) {
+            for (int j = 0; j < count; j++) out[j] += scratch.octave[j] * weight;
+        }
+        else {
+            for (int j = 0; j < count; j++) out[j] = (float)(out[j] + scratch.octave[j] * weight) / norm;
+        }
+    }
+}
+
+uint32_t latticeHash(uint32_t seed, int x, int y, int z) {
+    //As the 2D hash with y mixed in as well
+    uint32_t h = seed;
+    for (uint32_t v : {(uint32_t)x, (uint32_t)y, (uint32_t)z}) {
+        h ^= v + 0x9E3779B9u + (h << 6) + (h >> 2);
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+    }
+    return h;
+}
+
+//Unit gradients for 3D noise, towards the 12 edges of a cube
+static const float gradients3D[12][3] = {
+    {NOISE_SQRT1_2, NOISE_SQRT1_2, 0}, {-NOISE_SQRT1_2, NOISE_SQRT1_2, 0},
+    {NOISE_SQRT1_2, -NOISE_SQRT1_2, 0}, {-NOISE_SQRT1_2, -NOISE_SQRT1_2, 0},
+    {NOISE_SQRT1_2, 0, NOISE_SQRT1_2}, {-NOISE_SQRT1_2, 0, NOISE_SQRT1_2},
+    {NOISE_SQRT1_2, 0, -NOISE_SQRT1_2}, {-NOISE_SQRT1_2, 0, -NOISE_SQRT1_2},
+    {0, NOISE_SQRT1_2, NOISE_SQRT1_2}, {0, -NOISE_SQRT1_2, NOISE_SQRT1_2},
+    {0, NOISE_SQRT1_2, -NOISE_SQRT1_2}, {0, -NOISE_SQRT1_2, -NOISE_SQRT1_2}
+};
+
+/*Gradient noise over a box. Gradients of every lattice point the box touches are
+hashed once. Each sample is a blend of its cell's 8 corner dot products with
+fade weights, so it is at most the blend of the corner distances, which is at
+most sqrt(3)/2 with unit gradients. Scaling by that keeps output within [0, 1],
+& the final clamp only absorbs rounding.
+*/
+static void hashedNoise3D(float *out, int x0, int y0, int z0, int width, int height, int depth, int csize,
+        uint32_t seed, std::vector<const float*>& corners) {
+    int cx0 = floorDiv(x0, csize), cy0 = floorDiv(y0, csize), cz0 = floorDiv(z0, csize);
+    int nx = floorDiv(x0 + width - 1, csize) - cx0 + 2;
+    int ny = floorDiv(y0 + height - 1, csize) - cy0 + 2;
+    int nz = floorDiv(z0 + depth - 1, csize) - cz0 + 2;
+    corners.resize(nx * ny * nz);
+    for (int y = 0; y < ny; y++)
+    for (int z = 0; z < nz; z++)
+    for (int x = 0; x < nx; x++)
+        corners[(y * nz + z) * nx + x] = gradients3D[latticeHash(seed, cx0 + x, cy0 + y, cz0 + z) % 12];
+
+    const float scale = 2.0f / sqrtf(3.0f);
+    for (int y = 0; y < height; y++) {
+        int cy = floorDiv(y0 + y, csize);
+        float v = (float)(y0 + y - cy * csize) / csize, fy = smoothstep(v);
+        for (int z = 0; z < depth; z++) {
+            int cz = floorDiv(z0 + z, csize);
+            float w = (float)(z0 + z - cz * csize) / csize, fz = smoothstep(w);
+            const float **row = &corners[((cy - cy0) * nz + cz - cz0) * nx];
+            float *dst = out + (y * depth + z) * width;
+            //Along a row of a cell, y & z weights are fixed, so each x side is a line in u
+            for (int x = 0; x < width;) {
+                int cx = floorDiv(x0 + x, csize);
+                const float **c = row + cx - cx0;
+                float base[2], slope[2];
+                for (int side = 0; side < 2; side++) {
+                    //Corners at y, y + 1 are nz * nx apart, at z, z + 1 nx apart
+                    const float *g00 = c[side], *g01 = c[nx + side];
+                    const float *g10 = c[nz * nx + side], *g11 = c[nz * nx + nx + side];
+                    float y0z0 = g00[1] * v + g00[2] * w, y0z1 = g01[1] * v + g01[2] * (w - 1.0f);
+                    float y1z0 = g10[1] * (v - 1.0f) + g10[2] * w, y1z1 = g11[1] * (v - 1.0f) + g11[2] * (w - 1.0f);
+                    float y0b = y0z0 + (y0z1 - y0z0) * fz, y1b = y1z0 + (y1z1 - y1z0) * fz;
+                    float y0s = g00[0] + (g01[0] - g00[0]) * fz, y1s = g10[0] + (g11[0] - g10[0]) * fz;
+                    base[side] = y0b + (y1b - y0b) * fy;
+                    slope[side] = y0s + (y1s - y0s) * fy;
+                }
+                int end = std::min(width, (cx + 1) * csize - x0);
+                for (; x < end; x++) {
+                    float u = (float)(x0 + x - cx * csize) / csize;
+                    float left = base[0] + slope[0] * u, right = base[1] + slope[1] * (u - 1.0f);
+                    dst[x] = clamp01(((left + (right - left) * smoothstep(u)) * scale + 1.0f) * 0.5f);
+                }
+            }
+        }
+    }
+}
+
+void seededNoise3D(float *out, int x0, int y0, int z0, int width, int height, int depth, int csize, uint32_t seed) {
+    if (width <= 0 || height <= 0 || depth <= 0) return;
+    std::vector<const float*> corners;
+    hashedNoise3D(out, x0, y0, z0, width, height, depth, csize, seed, corners);
+}
+
+void seededFractalNoise3D(float *out, int x0, int y0, int z0, int width, int height, int depth, int csize,
+        int octaves, float lacunarity, float persistence, uint32_t seed) {
+    if (width <= 0 || height <= 0 || depth <= 0) return;
+    std::vector<const float*> corners;
+    hashedNoise3D(out, x0, y0, z0, width, height, depth, csize, seed, corners);
+    if (octaves <= 1) return;
+
+    //A weighted average of octaves each within [0, 1], so the sum stays within it too
+    float norm = 1;
+    for (int i = 1; i < octaves; i++) norm += pow(persistence, i);
+    int count = width * height * depth;
+    std::vector<float> octave(count);
+    for (int i = 1; i < octaves; i++) {
+        int cellSize = std::max((int)round((float)csize / pow(lacunarity, i)), 1);
+        hashedNoise3D(octave.data(), x0, y0, z0, width, height, depth, cellSize, latticeHash(seed, i, 0, 0), corners);
+        float weight = pow(persistence, i);
+        for (int j = 0; j < count; j++) out[j] += octave[j] * weight;
+    }
+    for (int j = 0; j < count; j++) out[j] = clamp01(out[j] / norm);
+}
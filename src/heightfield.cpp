@@ -0,0 +1,197 @@
+#include "heightfield.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Heightfield::Heightfield(size_t cacheBytes)
+        : _data(NULL), _size(0), _width(0), _depth(0), _format(HeightfieldFormat::UInt16), _low(0.0f),
+        _high(1.0f),
+#ifdef _WIN32
+        _file(INVALID_HANDLE_VALUE), _mapping(NULL),
+#endif
+        _cacheTiles(std::max(cacheBytes / (HEIGHTFIELD_TILE * HEIGHTFIELD_TILE * sizeof(float)), (size_t)1)) {}
+
+Heightfield::~Heightfield()
+{
+    close();
+}
+
+bool Heightfield::open(const char *path, int width, int depth, HeightfieldFormat format)
+{
+    close();
+    if (width <= 0 || depth <= 0) return false;
+    size_t needed = (size_t)width * depth * (format == HeightfieldFormat::UInt16 ? 2 : 4);
+#ifdef _WIN32
+    _file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || (unsigned long long)size.QuadPart < needed) {
+        close();
+        return false;
+    }
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping) _data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, needed);
+    if (!_data) {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &info) && (size_t)info.st_size >= needed)
+        data = mmap(NULL, needed, PROT_READ, MAP_SHARED, fd, 0);
+    //The mapping keeps the file open
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    _data = (const unsigned char*)data;
+#endif
+    _size = needed;
+    _width = width;
+    _depth = depth;
+    _format = format;
+    if (format == HeightfieldFormat::UInt16) setRange(0.0f, 65535.0f);
+    else setRange(0.0f, 1.0f);
+    return true;
+}
+
+void Heightfield::close()
+{
+#ifdef _WIN32
+    if (_data) UnmapViewOfFile(_data);
+    if (_mapping) CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+#else
+    if (_data) munmap((void*)_data, _size);
+#endif
+    _data = NULL;
+    _size = 0;
+    _width = _depth = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tiles.clear();
+    _uses.clear();
+}
+
+void Heightfield::setRange(float low, float high)
+{
+    //Tiles hold converted heights, so are rebuilt with the new range
+    std::lock_guard<std::mutex> lock(_mutex);
+    _low = low;
+    _high = high;
+    _tiles.clear();
+    _uses.clear();
+}
+
+int Heightfield::getLevels() const
+{
+    int levels = 0;
+    while (_data && (getWidth(levels) > 1 || getDepth(levels) > 1)) levels++;
+    return _data ? levels + 1 : 0;
+}
+
+void Heightfield::readRaster(float *out, int x0, int z0, int width, int depth) const
+{
+    float range = _high - _low;
+    for (int z = 0; z < depth; z++) {
+        size_t row = (size_t)std::min(std::max(z0 + z, 0), _depth - 1) * _width;
+        float *dst = out + (size_t)z * width;
+        for (int x = 0; x < width; x++) {
+            size_t i = row + std::min(std::max(x0 + x, 0), _width - 1);
+            float sample;
+            if (_format == HeightfieldFormat::UInt16) {
+                uint16_t value;
+                memcpy(&value, _data + i * 2, 2);
+                sample = value;
+            }
+            else memcpy(&sample, _data + i * 4, 4);
+            dst[x] = (sample - _low) / range;
+        }
+    }
+}
+
+void Heightfield::read(float *out, int x0, int z0, int width, int depth, int level) const
+{
+    if (!_data || width <= 0 || depth <= 0) return;
+    if (level == 0) return readRaster(out, x0, z0, width, depth);
+
+    /*Samples the window covers, clamped to the level, & the tiles holding them.
+    Clamping keeps the window's samples in order, so each tile fills a
+    rectangle of it, & the first & last tiles also fill the parts beyond the edges.*/
+    int lastX = getWidth(level) - 1, lastZ = getDepth(level) - 1;
+    int firstTileX = std::min(std::max(x0, 0), lastX) / HEIGHTFIELD_TILE;
+    int lastTileX = std::min(std::max(x0 + width - 1, 0), lastX) / HEIGHTFIELD_TILE;
+    int firstTileZ = std::min(std::max(z0, 0), lastZ) / HEIGHTFIELD_TILE;
+    int lastTileZ = std::min(std::max(z0 + depth - 1, 0), lastZ) / HEIGHTFIELD_TILE;
+    for (int tileZ = firstTileZ; tileZ <= lastTileZ; tileZ++) {
+        int zBegin = tileZ == firstTileZ ? 0 : tileZ * HEIGHTFIELD_TILE - z0;
+        int zEnd = tileZ == lastTileZ ? depth : (tileZ + 1) * HEIGHTFIELD_TILE - z0;
+        for (int tileX = firstTileX; tileX <= lastTileX; tileX++) {
+            int xBegin = tileX == firstTileX ? 0 : tileX * HEIGHTFIELD_TILE - x0;
+            int xEnd = tileX == lastTileX ? width : (tileX + 1) * HEIGHTFIELD_TILE - x0;
+            std::shared_ptr<const float> tile = getTile(level, tileX, tileZ);
+            for (int z = zBegin; z < zEnd; z++) {
+                int sz = std::min(std::max(z0 + z, 0), lastZ) - tileZ * HEIGHTFIELD_TILE;
+                const float *src = tile.get() + sz * HEIGHTFIELD_TILE;
+                float *dst = out + (size_t)z * width;
+                for (int x = xBegin; x < xEnd; x++)
+                    dst[x] = src[std::min(std::max(x0 + x, 0), lastX) - tileX * HEIGHTFIELD_TILE];
+            }
+        }
+    }
+}
+
+std::shared_ptr<const float> Heightfield::getTile(int level, int tileX, int tileZ) const
+{
+    uint64_t key = (uint64_t)level << 58 | (uint64_t)tileZ << 29 | (uint64_t)tileX;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _tiles.find(key);
+        if (found != _tiles.end()) {
+            _uses.splice(_uses.begin(), _uses, found->second.use);
+            return found->second.heights;
+        }
+    }
+    //Built without the lock as it reads the level below, threads racing to build a tile build the same heights
+    std::shared_ptr<const float> heights = buildTile(level, tileX, tileZ);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto inserted = _tiles.emplace(key, CachedTile());
+    if (!inserted.second) {
+        _uses.splice(_uses.begin(), _uses, inserted.first->second.use);
+        return inserted.first->second.heights;
+    }
+    _uses.push_front(key);
+    inserted.first->second = {heights, _uses.begin()};
+    //Readers still holding a dropped tile keep it alive until they're done
+    while (_tiles.size() > _cacheTiles) {
+        _tiles.erase(_uses.back());
+        _uses.pop_back();
+    }
+    return heights;
+}
+
+std::shared_ptr<const float> Heightfield::buildTile(int level, int tileX, int tileZ) const
+{
+    int size = 2 * HEIGHTFIELD_TILE;
+    std::vector<float> below((size_t)size * size);
+    read(below.data(), tileX * size, tileZ * size, size, size, level - 1);
+    std::shared_ptr<float> heights(new float[HEIGHTFIELD_TILE * HEIGHTFIELD_TILE], std::default_delete<float[]>());
+    for (int z = 0; z < HEIGHTFIELD_TILE; z++) {
+        const float *r0 = below.data() + 2 * z * size, *r1 = r0 + size;
+        float *dst = heights.get() + z * HEIGHTFIELD_TILE;
+        for (int x = 0; x < HEIGHTFIELD_TILE; x++)
+            dst[x] = (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1]) * 0.25f;
+    }
+    return heights;
+}
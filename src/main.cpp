@@ -3,19 +3,31 @@
 #include <iostream>
 #include <memory>
 #include <bitset>
+#include <atomic>
 #include <vector>
+#include <algorithm>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
-#include "glm/gtc/type_ptr.hpp"
 #include "stb_image.h"
 
-#include "shaders.h"
-#include "gradientnoise.h"
 #include "base.h"
+#include "renderer.h"
+#include "framescheduler.h"
+#include "simulation.h"
+#include "governor.h"
+#include "startup.h"
+#include "noisebench.h"
+#include "physicsbench.h"
+#include "erosion.h"
+#include "heightfield.h"
+#include "simd.h"
 
 #define DEG2RAD 0.01745329252
 #define DEFAULT_W 1600
@@ -24,73 +36,84 @@
 #define YDIM 64
 #define ZDIM 256
 
-unsigned int compileShader(const char *vertexShaderSource, const char *fragmentShaderSource);
-
-struct SquareData {
-    float pos[3];
-    int type;
-    int side;
-};
-
 void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, DEFAULT_W, DEFAULT_H);
 }
 
+//Key & cursor callbacks queue input for the simulation thread
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    Engine *engine = (Engine*)glfwGetWindowUserPointer(window);
-    switch (action)
+    Simulation *simulation = (Simulation*)glfwGetWindowUserPointer(window);
+    if (action != GLFW_PRESS && action != GLFW_RELEASE) return;
+    InputEvent event = {InputEventType::KeyEvent, PlayerMovement::Forward, action == GLFW_PRESS, 0.0, 0.0, steadySeconds()};
+    switch (key)
     {
-    case GLFW_PRESS:
-        switch (key)
-        {
-            case GLFW_KEY_W: engine->setPlayerMoving(PlayerMovement::Forward, true); break;
-            case GLFW_KEY_A: engine->setPlayerMoving(PlayerMovement::Left, true); break;
-            case GLFW_KEY_S: engine->setPlayerMoving(PlayerMovement::Backwards, true); break;
-            case GLFW_KEY_D: engine->setPlayerMoving(PlayerMovement::Right, true); break;
-            case GLFW_KEY_SPACE: engine->setPlayerMoving(PlayerMovement::Jump, true); break;
-            default: break;
-        }
-        break;
-    case GLFW_RELEASE:
-        switch (key)
-        {
-            case GLFW_KEY_W: engine->setPlayerMoving(PlayerMovement::Forward, false); break;
-            case GLFW_KEY_A: engine->setPlayerMoving(PlayerMovement::Left, false); break;
-            case GLFW_KEY_S: engine->setPlayerMoving(PlayerMovement::Backwards, false); break;
-            case GLFW_KEY_D: engine->setPlayerMoving(PlayerMovement::Right, false); break;
-            default: break;
-        }
-        break;
-    default:
-        break;
+        case GLFW_KEY_W: event.direction = PlayerMovement::Forward; break;
+        case GLFW_KEY_A: event.direction = PlayerMovement::Left; break;
+        case GLFW_KEY_S: event.direction = PlayerMovement::Backwards; break;
+        case GLFW_KEY_D: event.direction = PlayerMovement::Right; break;
+        //Jump is cleared by the engine once applied, so only presses are sent
+        case GLFW_KEY_SPACE: if (action != GLFW_PRESS) return; event.direction = PlayerMovement::Jump; break;
+        default: return;
     }
+    simulation->pushInput(event);
 }
 
 void cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
-    Engine *engine = (Engine*)glfwGetWindowUserPointer(window);
-    engine->cursorMoved(xpos, ypos);
+    Simulation *simulation = (Simulation*)glfwGetWindowUserPointer(window);
+    simulation->pushInput({InputEventType::CursorEvent, PlayerMovement::Forward, false, xpos, ypos, steadySeconds()});
 }
 
-int main(void) {
-    //GLFW & GLAD initialisation
-    if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(DEFAULT_W, DEFAULT_H, "glortVox", NULL, NULL);
-    if (!window) {
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        glfwTerminate();
-        return -1;
+int main(int argc, char **argv) {
+    //Startup timings are measured from here
+    StartupGraph startup;
+
+    //Command line options
+    FramePacing pacing = FramePacing::Hybrid;
+    FramePipeline pipeline = FramePipeline::Classic;
+    bool lateLatch = false;
+    GovernorInitData governorData;
+    governorData.targetFrameTime = 1.0 / MAX_FPS;
+    TerrainParams terrainParams;
+    //Raw heightfield to load instead of generating terrain, see Heightfield
+    const char *fieldPath = NULL;
+    int fieldWidth = 0, fieldDepth = 0, fieldLevel = -1;
+    HeightfieldFormat fieldFormat = HeightfieldFormat::UInt16;
+    bool noiseBench = false, physicsBench = false;
+    int entityCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--vsync")) pacing = FramePacing::VSync;
+        else if (!strcmp(argv[i], "--hybrid")) pacing = FramePacing::Hybrid;
+        else if (!strcmp(argv[i], "--uncapped")) pacing = FramePacing::Uncapped;
+        else if (!strcmp(argv[i], "--low-latency")) pipeline = FramePipeline::LowLatency;
+        else if (!strcmp(argv[i], "--late-latch")) lateLatch = true;
+        else if (!strncmp(argv[i], "--target-ms=", 12)) governorData.targetFrameTime = atof(argv[i] + 12) / 1000.0;
+        else if (!strncmp(argv[i], "--seed=", 7)) terrainParams.seed = strtoul(argv[i] + 7, NULL, 10);
+        else if (!strcmp(argv[i], "--simplex")) terrainParams.lattice = NoiseLattice::Simplex;
+        else if (!strncmp(argv[i], "--density=", 10)) terrainParams.densityAmplitude = atof(argv[i] + 10);
+        else if (!strncmp(argv[i], "--erode=", 8)) terrainParams.erosionIterations = atoi(argv[i] + 8);
+        else if (!strncmp(argv[i], "--heightfield=", 14)) fieldPath = argv[i] + 14;
+        else if (!strncmp(argv[i], "--heightfield-size=", 19)) sscanf(argv[i] + 19, "%dx%d", &fieldWidth, &fieldDepth);
+        else if (!strcmp(argv[i], "--heightfield-float")) fieldFormat = HeightfieldFormat::Float32;
+        else if (!strncmp(argv[i], "--heightfield-level=", 20)) fieldLevel = atoi(argv[i] + 20);
+        else if (!strcmp(argv[i], "--noise-bench")) noiseBench = true;
+        else if (!strcmp(argv[i], "--physics-bench")) physicsBench = true;
+        else if (!strncmp(argv[i], "--entities=", 11)) entityCount = atoi(argv[i] + 11);
+        else if (!strncmp(argv[i], "--isa=", 6)) {
+            //Kernels are bound to the detected instruction set until forced narrower here
+            SimdIsa isa;
+            if (!parseSimdIsa(argv[i] + 6, isa)) {
+                std::cout << "Unknown instruction set " << argv[i] + 6 << "\r\n";
+                return -1;
+            }
+            setSimdIsa(isa);
+        }
     }
+    std::cout << "Using " << simdIsaName(getSimdIsa()) << " kernels, " << simdIsaName(detectSimdIsa())
+        << " supported.\r\n";
+    if (noiseBench) return runNoiseBenchmark();
+    if (physicsBench) return runPhysicsBenchmark();
 
-    //Engine initialisation
+    //Engine initialisation, the map is filled in by the terrain task
     EngineInitData initData;
     initData.playerDimensions = {0.5f, 2.0f, 0.5f};
     initData.spawnPoint = {128.0f, 48.0f, 128.0f};
@@ -99,198 +122,244 @@ int main(void) {
     initData.mapDimensionsXYZ[2] = ZDIM;
     Engine engine(initData);
 
-    //Matrices, vectors. TODO: create constexpr rotate function 
-    glm::mat4 rotations[6];
-    rotations[0] = glm::mat4(1.0f);
-    rotations[1] = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    rotations[2] = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    rotations[3] = glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotations[4] = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotations[5] = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    //Perspective projection matrix
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)DEFAULT_W / (float)DEFAULT_H, 0.1f, 200.0f);
-    
-    //Generate heightmap
-    float hMap[256*256];
-    fractalNoise(hMap, 32, 8, 5, 1.5, 0.5);
+    //Perspective projection matrix, far plane is later set by the quality governor
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)DEFAULT_W / (float)DEFAULT_H, 0.1f, governorData.high.farPlane);
+    Simulation simulation(engine, projection);
 
-    //Map initialisation
-    engine.loadHeightmap(hMap, 48);
-    std::vector<SquareData> blockData;
+    //Quality starts at the highest level & is lowered if frames run over target
+    QualityGovernor governor(governorData);
+    QualitySettings quality = governor.getSettings();
+    simulation.setQuality(quality.farPlane, quality.lodDistance, quality.meshBudget);
 
-    //Generate visible faces
-    for (int x = 0; x < XDIM; x++)
-    for (int y = 0; y < YDIM; y++)
-    for (int z = 0; z < ZDIM; z++) {
-        //Skip if no block at location
-        if (!engine.getMap().at(x,y,z)) continue;
-        //Get surrounding blocks
-        std::bitset<6> s = engine.getMap().surroundingBlocks(x, y, z);
-        //Skip if block is entirely surrounded
-        if (s.all()) continue;
-        //2 corresponds to block above. if there is no block above, make block a grass block.
-        //TODO: create enum for surrounding block values, change bitset to typedef'd char.
-        int type = s[2] ? 1 : 0;
-        //push back square for each visible (i.e. not covered) face.
-        for (int j = 0; j < 6; j++)
-            if (!s[j]) blockData.push_back({{static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)}, type, j});
-    }
-
-    std::cout << blockData.size() << " visible faces.\r\n";
-
-    //Window setup
-    glfwSetWindowUserPointer(window, &engine);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
-    glfwSetKeyCallback(window, keyCallback);
-    glfwSetCursorPosCallback(window, cursorPosCallback);
-    glViewport(0, 0, DEFAULT_W, DEFAULT_H);
-
-    //Square vertices, left face
-    const float square[] = {
-        //xyz coords            //texture coords
-        -0.5f,  0.5f,   0.5f,   1.0f,   0.0f,
-        -0.5f,  0.5f,   -0.5f,  0.0f,   0.0f,
-        -0.5f,  -0.5f,  -0.5f,  0.0f,   1.0f,
-        -0.5f,  -0.5f,  -0.5f,  0.0f,   1.0f,
-        -0.5f,  -0.5f,  0.5f,   1.0f,   1.0f,
-        -0.5f,  0.5f,   0.5f,   1.0f,   0.0f
-    };
-
-    //Declare Buffers
-    unsigned int blockVAO, squareVBO, squareDataIBO;
-
-    //Generate VAO & VBOs
-    glGenVertexArrays(1, &blockVAO);
-    glGenBuffers(1, &squareVBO);
-    glGenBuffers(1, &squareDataIBO);
+    //Workers for startup tasks & draw recording, packets are recorded into per-thread buffers
+    ThreadPool pool;
+    CommandBuffer commands;
 
-    //Bind VAO & VBO
-    glBindVertexArray(blockVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(square), square, GL_STATIC_DRAW);
-
-    //Vertex positon
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    //Texture coords
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    //Bind instance buffer
-    glBindBuffer(GL_ARRAY_BUFFER, squareDataIBO);
-    glBufferData(GL_ARRAY_BUFFER, blockData.size() * sizeof(SquareData), blockData.data(), GL_STATIC_DRAW);
-    //Block Position
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SquareData), (void*)0);
-    glVertexAttribDivisor(2, 1);
-    glEnableVertexAttribArray(2);
-    //Block type
-    glVertexAttribIPointer(3, 1, GL_INT, sizeof(SquareData), (void*)(sizeof(int)*3));
-    glVertexAttribDivisor(3, 1);
-    glEnableVertexAttribArray(3);
-    //Side
-    glVertexAttribIPointer(4, 1, GL_INT, sizeof(SquareData), (void*)(4*sizeof(int)));
-    glVertexAttribDivisor(4, 1);
-    glEnableVertexAttribArray(4);
-
-    //Set up texture buffer
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    //Load texture map
-    int width, height, chans;
-    unsigned char *data = stbi_load("textures.png", &width, &height, &chans, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    //Block shader
-    unsigned int shaderProgram = compileShader(blockVert, blockFrag);
+    GLFWwindow *window = NULL, *uploadWindow = NULL;
+    int width = 0, height = 0;
+    std::shared_ptr<const unsigned char> textureData;
+    //Renderer owns all GL objects. Scoped so GL objects are released before the context is destroyed.
+    {
+    std::unique_ptr<UploadWorker> uploader;
+    std::unique_ptr<Renderer> renderer;
+
+    /*Startup dependency graph. Terrain generation, meshing & texture decoding run on
+    workers while the window & GL context come up on the main thread. Meshing
+    starts nearest the spawn point, so the first frame is drawn as soon as those
+    chunks are uploaded while the rest of the map streams in.*/
+    int terrain = startup.add("terrain", [&]() {
+        //Chunks are spread over the pool, nothing else runs parallelFor during startup
+        const Map& map = engine.getMap();
+        if (fieldPath) {
+            Heightfield field;
+            if (!field.open(fieldPath, fieldWidth, fieldDepth, fieldFormat)) {
+                std::cout << "Couldn't map " << fieldWidth << "x" << fieldDepth << " heightfield " << fieldPath << "\r\n";
+                return false;
+            }
+            //Defaults to the finest level that fits the whole raster on the map, centred either way
+            int level = fieldLevel;
+            if (level < 0) {
+                level = 0;
+                while (field.getWidth(level) > (int)map.getXDim() || field.getDepth(level) > (int)map.getZDim()) level++;
+            }
+            level = std::min(level, field.getLevels() - 1);
+            int x0 = (field.getWidth(level) - (int)map.getXDim()) / 2, z0 = (field.getDepth(level) - (int)map.getZDim()) / 2;
+            std::cout << "Heightfield level " << level << ", " << field.getWidth(level) << "x" << field.getDepth(level)
+                << " samples.\r\n";
+            pool.parallelFor(map.getChunksX() * map.getChunksZ(), [&](int chunk, int) {
+                engine.loadHeightfieldChunk(field, level, x0, z0, terrainParams.maxY, chunk % map.getChunksX(),
+                    chunk / map.getChunksX());
+            });
+            return true;
+        }
+        //Erosion needs the whole heightmap at once, chunks are then filled from it
+        std::vector<float> heightmap;
+        if (terrainParams.erosionIterations > 0) {
+            heightmap.resize(map.getXDim() * map.getZDim());
+            seededFractalNoise(heightmap.data(), 0, 0, map.getXDim(), map.getZDim(), terrainParams.cellSize,
+                terrainParams.octaves, terrainParams.lacunarity, terrainParams.persistence, terrainParams.seed,
+                terrainParams.lattice);
+            ErosionParams erosion;
+            erosion.iterations = terrainParams.erosionIterations;
+            erosion.heightScale = terrainParams.maxY;
+            erodeHeightmap(heightmap.data(), map.getXDim(), map.getZDim(), erosion, pool);
+        }
+        std::atomic<int> sampled(0);
+        pool.parallelFor(map.getChunksX() * map.getChunksZ(), [&](int chunk, int) {
+            sampled += engine.generateChunk(terrainParams, chunk % map.getChunksX(), chunk / map.getChunksX(),
+                heightmap.empty() ? NULL : heightmap.data());
+        });
+        if (terrainParams.densityAmplitude > 0) {
+            int sections = map.getChunksX() * map.getChunksZ() * ((map.getYDim() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+            std::cout << "3D density sampled in " << sampled << " of " << sections << " sections.\r\n";
+        }
+        return true;
+    });
+    //Engine belongs to the simulation thread from here on
+    startup.add("simulation start", [&]() {
+        //Entities start at random points along the top of the map, walking in random directions
+        const Map& map = engine.getMap();
+        for (int i = 0; i < entityCount; i++) {
+            float angle = glm::radians((float)(rand() % 360));
+            engine.getEntities().spawn({(float)(rand() % map.getXDim()) + 0.5f, map.getYDim() - 2.0f,
+                (float)(rand() % map.getZDim()) + 0.5f}, {0.6f, 1.8f, 0.6f}, {cosf(angle), 0.0f, sinf(angle)});
+        }
+        simulation.start();
+        return true;
+    }, {terrain});
+    int decode = startup.add("texture decode", [&]() {
+        int chans;
+        textureData.reset(stbi_load("textures.png", &width, &height, &chans, 0), stbi_image_free);
+        return true;
+    });
+    int context = startup.add("window", [&]() {
+        if (!glfwInit()) return false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(DEFAULT_W, DEFAULT_H, "glortVox", NULL, NULL);
+        if (!window) return false;
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        //Hidden window whose context shares objects with the main one, for uploads
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        uploadWindow = glfwCreateWindow(1, 1, "", NULL, window);
+
+        //Window setup
+        glfwSetWindowUserPointer(window, &simulation);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetCursorPosCallback(window, cursorPosCallback);
+        return true;
+    }, {}, true);
+    int shaders = startup.add("renderer", [&]() {
+        //Uploads go through the upload window's context, or the render thread if it couldn't be created
+        GLFWwindow *shared = uploadWindow;
+        uploader.reset(new UploadWorker([=]() { glfwMakeContextCurrent(shared); }, []() { glfwMakeContextCurrent(NULL); }));
+        renderer.reset(new Renderer(DEFAULT_W, DEFAULT_H));
+        renderer->setProjection(projection);
+        renderer->setUploadBudget(quality.uploadBudget);
+        if (uploadWindow) {
+            renderer->setUploadWorker(uploader.get());
+            uploader->start();
+        }
+        return true;
+    }, {context}, true);
+    //Texture data is freed once the upload is done with it
+    startup.add("texture upload", [&]() {
+        if (textureData) renderer->queueTexture(textureData, width, height);
+        textureData.reset();
+        return true;
+    }, {shaders, decode}, true);
+
+    bool started = startup.run(pool);
+    startup.report();
+    if (!started) {
+        simulation.stop();
+        if (uploader) uploader->stop();
+        renderer.reset();
+        glfwTerminate();
+        return -1;
+    }
 
-    //Setting state variables
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    //Frame pacing, sets swap interval so must come after context creation
+    FrameScheduler scheduler(pacing, MAX_FPS);
 
-    //Set background to sky blue :-)
-    glClearColor(0.8f, 1.0f, 1.0f, 1.0f);
+    //Input timestamp to submit latency, recorded once per newly applied input
+    RunningStats inputLatency;
+    double lastInputTime = 0.0;
+    //Cursor position last read when late latching, & when it was first seen moved from the snapshot's
+    double latchedX = NAN, latchedY = NAN, latchedTime = 0.0;
+    //Startup ends with the first frame that draws chunks, & once every chunk is meshed & uploaded
+    double firstFrame = 0.0, fullyLoaded = 0.0;
 
-    //Main loop
+    //Main loop, draws the latest snapshot published by the simulation thread
     while (!glfwWindowShouldClose(window))
     {
-        //Get time from start of frame, swap buffers & clear
-        double time = glfwGetTime();
-        glfwSwapBuffers(window);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        //Get matrix locations
-        int modelMat = glGetUniformLocation(shaderProgram, "model");
-        int viewMat = glGetUniformLocation(shaderProgram, "view");
-        int projMat = glGetUniformLocation(shaderProgram, "projection");
-        int rotMatAr = glGetUniformLocation(shaderProgram, "rotations");
-
-        //Bind program, set uniform values & bind cube vertex array
-        glUseProgram(shaderProgram);
-        glUniformMatrix4fv(viewMat, 1, GL_FALSE, glm::value_ptr(engine.getCamera()));
-        glUniformMatrix4fv(projMat, 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(rotMatAr, 6, GL_FALSE, glm::value_ptr(rotations[0]));
-        glBindVertexArray(blockVAO);
+        //Mark start of frame. Classic pipeline swaps first, presenting last frame's work.
+        scheduler.beginFrame();
+        if (pipeline == FramePipeline::Classic)
+            glfwSwapBuffers(window);
+        else
+            glfwPollEvents(); //Low latency samples input as late as possible, right before drawing
+
+        //Upload changed chunk meshes within budget & draw visible chunks from the latest snapshot
+        double workStart = steadySeconds();
+        const FrameSnapshot *snapshot = simulation.latestSnapshot();
+        if (snapshot) {
+            for (const ChunkMeshUpdate& update : snapshot->dirtyMeshes)
+                renderer->queueChunk({update.chunk, update.version, update.topCount, update.instances});
+            renderer->processUploads();
+
+            //Camera is built last, optionally re-reading the cursor just before the view upload
+            glm::mat4 view;
+            double inputTime = snapshot->latestInputTime;
+            if (lateLatch) {
+                double cursorX, cursorY;
+                glfwGetCursorPos(window, &cursorX, &cursorY);
+                double now = steadySeconds();
+                //Cursor movement the snapshot hasn't applied is an input sample from when it was first read
+                if (cursorX != latchedX || cursorY != latchedY) {
+                    latchedX = cursorX;
+                    latchedY = cursorY;
+                    if (!snapshot->cursorValid || cursorX != snapshot->cursorX || cursorY != snapshot->cursorY)
+                        latchedTime = now;
+                }
+                inputTime = std::max(inputTime, latchedTime);
+                view = simulation.lateLatchedCamera(*snapshot, now, cursorX, cursorY);
+            }
+            else view = simulation.renderCamera(*snapshot, steadySeconds());
+            renderer->recordChunks(pool, view, snapshot->visibleChunks, commands);
+            renderer->drawFrame(view, commands);
+            simulation.acknowledge(snapshot->tick);
+
+            if (!firstFrame && renderer->getFrameDraws()) {
+                firstFrame = steadySeconds();
+                std::cout << "First frame after " << (firstFrame - startup.getOrigin()) * 1000.0 << " ms.\r\n";
+            }
+            if (!fullyLoaded && snapshot->meshed && !renderer->getQueuedUploads() && !renderer->getUploadsInFlight()) {
+                fullyLoaded = steadySeconds();
+                std::cout << "Fully loaded after " << (fullyLoaded - startup.getOrigin()) * 1000.0 << " ms.\r\n";
+            }
+
+            if (inputTime > lastInputTime) {
+                inputLatency.add(steadySeconds() - inputTime);
+                lastInputTime = inputTime;
+            }
+        }
 
-        //Draw map
-        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, blockData.size());
+        //Adjust quality to hold CPU frame time (excluding swap & pacing) at the target
+        if (governor.update(steadySeconds() - workStart)) {
+            quality = governor.getSettings();
+            renderer->setProjection(glm::perspective(glm::radians(45.0f), (float)DEFAULT_W / (float)DEFAULT_H, 0.1f, quality.farPlane));
+            simulation.setQuality(quality.farPlane, quality.lodDistance, quality.meshBudget);
+            renderer->setUploadBudget(quality.uploadBudget);
+        }
 
-        //Poll events
-        glfwPollEvents();
+        if (pipeline == FramePipeline::Classic)
+            glfwPollEvents(); //Poll events, callbacks queue input for the simulation thread
+        else
+            glfwSwapBuffers(window);
 
-        //Action events
-        engine.update();
-        
         //Wait for frame
-        while (glfwGetTime() < time + 1.0 / MAX_FPS) {}
+        scheduler.endFrame();
+    }
+    simulation.stop();
+    uploader->stop();
+    std::cout << renderer->getFrameCalls() << " GL calls per frame.\r\n";
+    FrameStats stats = scheduler.getStats();
+    std::cout << stats.frames << " frames, mean " << stats.meanFrameTime * 1000.0 << " ms, jitter "
+        << stats.jitter * 1000.0 << " ms, max deviation " << stats.maxDeviation * 1000.0 << " ms.\r\n";
+    std::cout << "Input to submit latency: mean " << inputLatency.mean * 1000.0 << " ms, max "
+        << inputLatency.max * 1000.0 << " ms over " << inputLatency.count << " inputs.\r\n";
     }
+    if (uploadWindow) glfwDestroyWindow(uploadWindow);
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
 }
-
-//Shader compiling utility function, adapted from Learn OpenGL by Joey de Vries
-unsigned int compileShader(const char *vertexShaderSource, const char *fragmentShaderSource) {
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    int success;
-    char infoLog[512];
-
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, fragmentShader);
-    glAttachShader(shaderProgram, vertexShader);
-
-    glLinkProgram(shaderProgram);
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    
-    return shaderProgram;
-}
\ No newline at end of file
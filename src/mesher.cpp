@@ -0,0 +1,46 @@
+#include "mesher.h"
+#include "simd.h"
+
+int meshChunk(const Map& map, int chunkX, int chunkZ, std::vector<SquareData>& out)
+{
+    int x0 = chunkX * CHUNK_SIZE, z0 = chunkZ * CHUNK_SIZE;
+    int x1 = glm::min(x0 + CHUNK_SIZE, (int)map.getXDim());
+    int z1 = glm::min(z0 + CHUNK_SIZE, (int)map.getZDim());
+    int width = x1 - x0;
+    //Side faces are held back & appended after all top faces
+    std::vector<SquareData> sides;
+    size_t first = out.size();
+    //Stands in for rows beyond the map, which are air
+    static const bool air[CHUNK_SIZE] = {};
+    bool row[CHUNK_SIZE + 2];
+    uint8_t masks[CHUNK_SIZE];
+    auto neighbour = [&](int y, int z) {
+        bool inside = y >= 0 && y < (int)map.getYDim() && z >= 0 && z < (int)map.getZDim();
+        return inside ? map.row(y, z) + x0 : air;
+    };
+    //Generate visible faces a row along x at a time, masks as surroundingBlocks, set for uncovered faces
+    for (int y = 0; y < (int)map.getYDim(); y++)
+    for (int z = z0; z < z1; z++) {
+        const bool *blocks = map.row(y, z) + x0;
+        row[0] = map.at(x0 - 1, y, z);
+        std::copy(blocks, blocks + width, row + 1);
+        row[width + 1] = map.at(x1, y, z);
+        simdKernels().faceMasks(row, neighbour(y, z - 1), neighbour(y, z + 1), neighbour(y + 1, z),
+            neighbour(y - 1, z), width, masks);
+        for (int i = 0; i < width; i++) {
+            if (!masks[i]) continue;
+            //If there is no block above, make block a grass block.
+            int type = masks[i] >> TOP_SIDE & 1 ? 0 : 1;
+            //push back square for each visible (i.e. not covered) face.
+            for (int j = 0; j < 6; j++) {
+                if (!(masks[i] >> j & 1)) continue;
+                SquareData square = {{static_cast<float>(x0 + i), static_cast<float>(y), static_cast<float>(z)}, type, j};
+                if (j == TOP_SIDE) out.push_back(square);
+                else sides.push_back(square);
+            }
+        }
+    }
+    int tops = out.size() - first;
+    out.insert(out.end(), sides.begin(), sides.end());
+    return tops;
+}
@@ -0,0 +1,141 @@
+#include "noisebench.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+
+#include "gradientnoise.h"
+#include "erosion.h"
+#include "stats.h"
+
+#define BENCH_SIZE 1024
+#define BENCH_CELL 32
+#define BENCH_OCTAVES 5
+#define BENCH_SEED 1
+//Steps between values compared for correlation
+#define BENCH_LAG 8
+#define HISTOGRAM_BINS 10
+
+//Best of a few runs, in ms per megapixel
+static double timeNoise(const std::function<void()>& fn, double pixels = BENCH_SIZE * BENCH_SIZE) {
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || ms < best) best = ms;
+    }
+    return best / (pixels / 1e6);
+}
+
+static void printStats(const char *name, const std::vector<float>& noise) {
+    RunningStats values;
+    int bins[HISTOGRAM_BINS] = {};
+    for (float v : noise) {
+        values.add(v);
+        bins[v >= 1.0f ? HISTOGRAM_BINS - 1 : (int)(v * HISTOGRAM_BINS)]++;
+    }
+    std::cout << name << ": mean " << values.mean << ", stddev " << values.stddev() << "\r\n  histogram";
+    for (int i = 0; i < HISTOGRAM_BINS; i++)
+        std::cout << ' ' << std::setw(4) << (int)(1000.0 * bins[i] / noise.size());
+    std::cout << " (per mille)\r\n";
+
+    //Slope & lagged correlation along each direction, diagonals step both axes
+    const int steps[4][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}};
+    const char *angles[4] = {"0", "45", "90", "135"};
+    for (int d = 0; d < 4; d++) {
+        int sx = steps[d][0], sz = steps[d][1];
+        double stepLength = sqrt((double)(sx * sx + sz * sz));
+        double slope = 0.0, covariance = 0.0;
+        long samples = 0;
+        for (int z = 0; z + BENCH_LAG * sz < BENCH_SIZE; z++) {
+            for (int x = BENCH_LAG; x < BENCH_SIZE - BENCH_LAG; x++) {
+                float v = noise[z * BENCH_SIZE + x];
+                float next = noise[(z + sz) * BENCH_SIZE + x + sx];
+                float lagged = noise[(z + BENCH_LAG * sz) * BENCH_SIZE + x + BENCH_LAG * sx];
+                slope += (next - v) * (next - v) / (stepLength * stepLength);
+                covariance += (v - values.mean) * (lagged - values.mean);
+                samples++;
+            }
+        }
+        double variance = values.stddev() * values.stddev();
+        std::cout << "  " << std::setw(3) << angles[d] << " deg: slope RMS " << sqrt(slope / samples)
+            << ", correlation at distance " << BENCH_LAG * stepLength << " " << covariance / samples / variance << "\r\n";
+    }
+}
+
+int runNoiseBenchmark() {
+    std::vector<float> noise(BENCH_SIZE * BENCH_SIZE);
+    float *out = noise.data();
+    int n = BENCH_SIZE / BENCH_CELL;
+    //Up to the instruction set bound, so --isa caps the kernels compared
+    SimdIsa bound = getSimdIsa();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Noise benchmark, " << BENCH_SIZE << "x" << BENCH_SIZE << ", cell size " << BENCH_CELL
+        << ", ms per megapixel:\r\n";
+    for (int isa = SimdIsa::Scalar; isa <= bound; isa++) {
+        setSimdIsa((SimdIsa)isa);
+        std::cout << "  gradientNoise (" << simdIsaName((SimdIsa)isa) << ") "
+            << timeNoise([&]() { gradientNoise(out, BENCH_CELL, n, BENCH_SIZE, BENCH_SIZE); }) << "\r\n";
+    }
+    std::cout << "  seededNoise " << timeNoise([&]() {
+        seededNoise(out, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_SEED); }) << "\r\n";
+    std::cout << "  simplexNoise " << timeNoise([&]() {
+        simplexNoise(out, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_SEED); }) << "\r\n";
+    for (int lattice = NoiseLattice::Square; lattice <= NoiseLattice::Simplex; lattice++) {
+        std::cout << "  seededFractalNoise, " << BENCH_OCTAVES << " octaves ("
+            << (lattice == NoiseLattice::Square ? "square" : "simplex") << ") " << timeNoise([&]() {
+            seededFractalNoise(out, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_OCTAVES, 1.5f, 0.5f,
+                BENCH_SEED, (NoiseLattice)lattice); }) << "\r\n";
+    }
+    setSimdIsa(bound);
+
+    //Multiresolution octaves against the reference, on a larger map with a deeper stack too
+    const int stacks[2][3] = {{BENCH_CELL, BENCH_SIZE / BENCH_CELL, BENCH_OCTAVES}, {256, 8, 10}};
+    for (const int *stack : stacks) {
+        int size = stack[0] * stack[1];
+        std::vector<float> full(size * size), multi(size * size);
+        double times[2];
+        for (int sampling = OctaveSampling::FullResolution; sampling <= OctaveSampling::Multiresolution; sampling++) {
+            float *dst = sampling == OctaveSampling::FullResolution ? full.data() : multi.data();
+            times[sampling] = timeNoise([&]() {
+                srand(BENCH_SEED);
+                fractalNoise(dst, stack[0], stack[1], stack[2], 1.5f, 0.5f, (OctaveSampling)sampling);
+            }, (double)size * size);
+        }
+        RunningStats error;
+        for (int i = 0; i < size * size; i++) error.add(fabsf(full[i] - multi[i]));
+        std::cout << "  fractalNoise " << size << "x" << size << ", cell size " << stack[0] << ", " << stack[2]
+            << " octaves: full " << times[0] << ", multiresolution " << times[1] << " (x" << times[0] / times[1]
+            << "), error max " << std::setprecision(5) << error.max << " mean " << error.mean
+            << std::setprecision(2) << "\r\n";
+    }
+
+    //Erosion of a heightmap on one thread, once per kernel as each run takes a while
+    ErosionParams erosion;
+    std::vector<float> heights(BENCH_SIZE * BENCH_SIZE);
+    for (int isa = SimdIsa::Scalar; isa <= std::min(bound, SimdIsa::AVX2); isa += SimdIsa::AVX2) {
+        setSimdIsa((SimdIsa)isa);
+        seededFractalNoise(heights.data(), 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_OCTAVES, 1.5f, 0.5f,
+            BENCH_SEED);
+        auto start = std::chrono::steady_clock::now();
+        erodeHeightmap(heights.data(), BENCH_SIZE, BENCH_SIZE, erosion);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  erodeHeightmap, " << erosion.iterations << " iterations (" << simdIsaName((SimdIsa)isa) << ") "
+            << ms / (BENCH_SIZE * BENCH_SIZE / 1e6) << "\r\n";
+    }
+    setSimdIsa(bound);
+
+    //Diagonals are compared at a longer distance, so only 0 & 90 or 45 & 135 should match
+    std::cout << std::setprecision(3) << "Statistics, cell size " << BENCH_CELL << ":\r\n";
+    seededNoise(out, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_SEED);
+    printStats("Square lattice", noise);
+    simplexNoise(out, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_CELL, BENCH_SEED);
+    printStats("Simplex lattice", noise);
+    return 0;
+}
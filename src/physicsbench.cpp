@@ -0,0 +1,115 @@
+#include "physicsbench.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "base.h"
+#include "entities.h"
+#include "raycast.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#define BENCH_MAP_SIZE 512
+#define BENCH_MAP_HEIGHT 64
+#define BENCH_SEED 1
+#define BENCH_TICK (1.0f / 60.0f)
+#define BENCH_GRAVITY 9.81f
+//Ticks entities fall for before timing, & ticks timed
+#define BENCH_SETTLE_TICKS 300
+#define BENCH_TICKS 60
+#define BENCH_RAYS (1 << 18)
+#define BENCH_RAY_DISTANCE 128.0f
+
+static float randomRange(float low, float high) {
+    return low + (high - low) * (float)rand() / RAND_MAX;
+}
+
+//Entities spread over the map above the terrain, walking in random directions
+static void spawnEntities(EntityStore& entities, int count) {
+    srand(BENCH_SEED);
+    entities.clear();
+    for (int i = 0; i < count; i++) {
+        float angle = randomRange(0.0f, 6.2831853f);
+        entities.spawn({randomRange(1.0f, BENCH_MAP_SIZE - 1.0f), BENCH_MAP_HEIGHT - 2.0f,
+            randomRange(1.0f, BENCH_MAP_SIZE - 1.0f)}, {0.6f, 1.8f, 0.6f}, {3.0f * cosf(angle), 0.0f, 3.0f * sinf(angle)});
+    }
+}
+
+//Best of a few runs, in millions of rays per second
+static double timeRays(const std::function<void()>& fn) {
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || s < best) best = s;
+    }
+    return BENCH_RAYS / best / 1e6;
+}
+
+//Mean ms per tick over BENCH_TICKS
+template <typename Tick>
+static double timeTicks(Tick tick) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_TICKS; i++) tick();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCH_TICKS;
+}
+
+int runPhysicsBenchmark() {
+    Map map(BENCH_MAP_SIZE, BENCH_MAP_HEIGHT, BENCH_MAP_SIZE);
+    std::vector<float> heights(BENCH_MAP_SIZE * BENCH_MAP_SIZE);
+    seededFractalNoise(heights.data(), 0, 0, BENCH_MAP_SIZE, BENCH_MAP_SIZE, 32, 5, 1.5f, 0.5f, BENCH_SEED);
+    map.fillColumns(0, 0, BENCH_MAP_SIZE, BENCH_MAP_SIZE, heights.data(), 48.0f);
+    ThreadPool pool;
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Physics benchmark, " << BENCH_MAP_SIZE << "x" << BENCH_MAP_HEIGHT << "x" << BENCH_MAP_SIZE
+        << " map, ms per tick (" << 1000.0f * BENCH_TICK << " ms budget):\r\n";
+    const int counts[] = {1000, 10000, 50000};
+    EntityStore entities;
+    for (int count : counts) {
+        spawnEntities(entities, count);
+        for (int i = 0; i < BENCH_SETTLE_TICKS; i++) entities.update(map, BENCH_TICK, BENCH_GRAVITY, pool);
+        int grounded = 0;
+        for (int e = 0; e < entities.size(); e++) grounded += entities.getFlags(e) & EntityFlags::Grounded;
+        double single = timeTicks([&]() { entities.update(map, BENCH_TICK, BENCH_GRAVITY); });
+        double threaded = timeTicks([&]() { entities.update(map, BENCH_TICK, BENCH_GRAVITY, pool); });
+        std::cout << "  " << std::setw(5) << count << " entities (" << grounded << " grounded): 1 thread " << single
+            << ", " << pool.getThreadCount() << " threads " << threaded << ", "
+            << std::setprecision(1) << count / single / 1000.0 << "M entity ticks/s on 1 thread"
+            << std::setprecision(3) << "\r\n";
+    }
+
+    //Rays from above the terrain in random directions, most reaching the ground, as for picking & sight lines
+    srand(BENCH_SEED);
+    std::vector<glm::vec3> origins(BENCH_RAYS), directions(BENCH_RAYS);
+    std::vector<RayHit> hits(BENCH_RAYS);
+    for (int i = 0; i < BENCH_RAYS; i++) {
+        origins[i] = {randomRange(0.0f, BENCH_MAP_SIZE), randomRange(40.0f, BENCH_MAP_HEIGHT),
+            randomRange(0.0f, BENCH_MAP_SIZE)};
+        directions[i] = {randomRange(-1.0f, 1.0f), randomRange(-1.0f, 0.2f), randomRange(-1.0f, 1.0f)};
+    }
+    std::cout << std::setprecision(2) << "Raycasts, up to " << BENCH_RAY_DISTANCE << " blocks, millions of rays per second:\r\n";
+    std::cout << "  raycast, 1 thread " << timeRays([&]() {
+        for (int i = 0; i < BENCH_RAYS; i++) raycast(map, origins[i], directions[i], BENCH_RAY_DISTANCE, hits[i]);
+    }) << "\r\n";
+    SimdIsa bound = getSimdIsa();
+    for (int isa = SimdIsa::Scalar; isa <= std::min(bound, SimdIsa::AVX2); isa += SimdIsa::AVX2) {
+        setSimdIsa((SimdIsa)isa);
+        std::cout << "  raycastBatch (" << simdIsaName((SimdIsa)isa) << "), 1 thread " << timeRays([&]() {
+            raycastBatch(map, origins.data(), directions.data(), BENCH_RAYS, BENCH_RAY_DISTANCE, hits.data());
+        }) << ", " << pool.getThreadCount() << " threads " << timeRays([&]() {
+            raycastBatch(map, origins.data(), directions.data(), BENCH_RAYS, BENCH_RAY_DISTANCE, hits.data(), pool);
+        }) << "\r\n";
+    }
+    setSimdIsa(bound);
+    int hit = 0;
+    for (const RayHit& h : hits) hit += h.distance != INFINITY;
+    std::cout << "  " << 100.0 * hit / BENCH_RAYS << "% of rays hit a block\r\n";
+    return 0;
+}
@@ -0,0 +1,381 @@
+#include "raycast.h"
+#include <math.h>
+#include <algorithm>
+
+#include "base.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RAYCAST_SIMD
+#include <immintrin.h>
+#endif
+
+//Side of the face entered through, by axis & whether the ray steps down that axis
+static const int entrySides[3][2] = {{0, 3}, {1, 2}, {5, 4}};
+
+/*Rays of a packet part way through the map, one lane per ray: the block each is
+in, the distance it entered it at & through which axis (-1 if it started there),
+& per axis its step, origin, reciprocal direction & the distance to its next
+block boundary. Lanes stop being active once they hit a block or are done.*/
+struct RayPacket {
+    int cell[3][RAY_PACKET];
+    int step[3][RAY_PACKET];
+    float origin[3][RAY_PACKET];
+    float inverse[3][RAY_PACKET];
+    float next[3][RAY_PACKET];
+    float t[RAY_PACKET];
+    int axis[RAY_PACKET];
+    bool active[RAY_PACKET];
+    bool hit[RAY_PACKET];
+};
+
+/*Distance along a lane's ray to the boundary plane at plane on an axis. Always
+worked out from the plane rather than accumulated while stepping, so
+traversals that skip blocks get the same distances as ones that don't.*/
+static inline float planeDistance(const RayPacket& p, int axis, int lane, int plane)
+{
+    return ((float)plane - p.origin[axis][lane]) * p.inverse[axis][lane];
+}
+
+//Clip a lane's ray to the map & find the block it starts in, inactive if it misses the map within maxDistance
+static void setupLane(const Map& map, glm::vec3 origin, glm::vec3 direction, float maxDistance, RayPacket& p,
+    int lane)
+{
+    p.active[lane] = false;
+    p.hit[lane] = false;
+    float length = glm::length(direction);
+    if (!(length > 0.0f)) return;
+    direction /= length;
+    float dims[3] = {(float)map.getXDim(), (float)map.getYDim(), (float)map.getZDim()};
+    float enter = -INFINITY, exit = INFINITY;
+    int enterAxis = -1;
+    for (int i = 0; i < 3; i++) {
+        if (direction[i] == 0.0f) {
+            if (origin[i] < 0.0f || origin[i] >= dims[i]) return;
+            continue;
+        }
+        float t0 = (0.0f - origin[i]) / direction[i], t1 = (dims[i] - origin[i]) / direction[i];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > enter) {
+            enter = t0;
+            enterAxis = i;
+        }
+        exit = std::min(exit, t1);
+    }
+    if (enter > exit || exit < 0.0f || enter > maxDistance) return;
+    //Rays starting in the map enter no face
+    float t = 0.0f;
+    if (enter > 0.0f) t = enter;
+    else enterAxis = -1;
+    glm::vec3 start = origin + direction * t;
+    for (int i = 0; i < 3; i++) {
+        int cell = std::min(std::max((int)floorf(start[i]), 0), (int)dims[i] - 1);
+        int step = direction[i] > 0.0f ? 1 : direction[i] < 0.0f ? -1 : 0;
+        p.cell[i][lane] = cell;
+        p.step[i][lane] = step;
+        p.origin[i][lane] = origin[i];
+        p.inverse[i][lane] = step ? 1.0f / direction[i] : INFINITY;
+        p.next[i][lane] = step ? planeDistance(p, i, lane, cell + (step > 0)) : INFINITY;
+    }
+    p.t[lane] = t;
+    p.axis[lane] = enterAxis;
+    p.active[lane] = true;
+}
+
+/*Move a lane's ray out of the empty cell of the occupancy pyramid it's in, as
+stepping block by block would: the axis whose cell boundary is crossed first,
+ties broken as traverseLane, is stepped across it last, after every other axis'
+boundaries before it. Those are found from where the ray is then & corrected
+against planeDistance, so the ray comes out in the same block at the same
+distance. Cells are clipped to the map, so only leaving through the last
+boundary leaves it.*/
+static void skipCell(RayPacket& p, int lane, int level, float end, const int dims[3])
+{
+    int boundaries[3];
+    float exits[3];
+    for (int i = 0; i < 3; i++) {
+        int step = p.step[i][lane];
+        exits[i] = INFINITY;
+        if (!step) continue;
+        int low = p.cell[i][lane] >> level << level;
+        boundaries[i] = step > 0 ? std::min(low + (1 << level), dims[i]) : low;
+        exits[i] = planeDistance(p, i, lane, boundaries[i]);
+    }
+    int axis = exits[0] <= exits[1] ? (exits[0] <= exits[2] ? 0 : 2) : (exits[1] <= exits[2] ? 1 : 2);
+    float t = exits[axis];
+    //Rays ending in the cell miss
+    if (t > end) {
+        p.active[lane] = false;
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        int step = p.step[i][lane], offset = step > 0;
+        if (i == axis || !step) continue;
+        //First boundary not crossed by t, between the next one & the cell's
+        int first = p.cell[i][lane] + offset, plane = (int)floorf(p.origin[i][lane] + t / p.inverse[i][lane]) + offset;
+        plane = step > 0 ? std::min(std::max(plane, first), boundaries[i]) : std::min(std::max(plane, boundaries[i]), first);
+        auto crossed = [&](int boundary) {
+            float distance = planeDistance(p, i, lane, boundary);
+            return distance < t || (distance == t && i < axis);
+        };
+        while (plane != first && !crossed(plane - step)) plane -= step;
+        while (plane != boundaries[i] && crossed(plane)) plane += step;
+        p.cell[i][lane] = plane - offset;
+        p.next[i][lane] = planeDistance(p, i, lane, plane);
+    }
+    int step = p.step[axis][lane], cell = boundaries[axis] - 1 + (step > 0);
+    p.cell[axis][lane] = cell;
+    p.next[axis][lane] = planeDistance(p, axis, lane, cell + (step > 0));
+    p.t[lane] = t;
+    p.axis[lane] = axis;
+    if (cell < 0 || cell >= dims[axis]) p.active[lane] = false;
+}
+
+//Level of the largest empty cell of the occupancy pyramid a lane is in, below MIN_SKIP_LEVEL if there's none to skip
+static int emptyLevel(const Map& map, const RayPacket& p, int lane)
+{
+    int x = p.cell[0][lane], y = p.cell[1][lane], z = p.cell[2][lane];
+    int level = MIN_SKIP_LEVEL - 1;
+    while (level + 1 < map.getOccupancyLevels() && !map.occupancy(level + 1, x >> (level + 1), y >> (level + 1),
+        z >> (level + 1))) level++;
+    return level;
+}
+
+/*Step one lane's ray through blocks until it hits one, passes end or leaves the
+map. Empty cells of the occupancy pyramid from MIN_SKIP_LEVEL up are skipped
+whole, from the largest one the ray is in.*/
+static void traverseLane(const Map& map, RayPacket& p, int lane, float end)
+{
+    const bool *blocks = map.getBlocks();
+    int dims[3] = {(int)map.getXDim(), (int)map.getYDim(), (int)map.getZDim()};
+    while (p.active[lane]) {
+        if (blocks[p.cell[0][lane] + p.cell[1][lane] * dims[0] * dims[2] + p.cell[2][lane] * dims[0]]) {
+            p.hit[lane] = true;
+            p.active[lane] = false;
+            break;
+        }
+        int level = emptyLevel(map, p, lane);
+        if (level >= MIN_SKIP_LEVEL) {
+            skipCell(p, lane, level, end, dims);
+            continue;
+        }
+        float nx = p.next[0][lane], ny = p.next[1][lane], nz = p.next[2][lane];
+        int axis = nx <= ny ? (nx <= nz ? 0 : 2) : (ny <= nz ? 1 : 2);
+        float t = p.next[axis][lane];
+        if (t > end) {
+            p.active[lane] = false;
+            break;
+        }
+        int step = p.step[axis][lane], cell = p.cell[axis][lane] + step;
+        p.cell[axis][lane] = cell;
+        p.next[axis][lane] = planeDistance(p, axis, lane, cell + (step > 0));
+        p.t[lane] = t;
+        p.axis[lane] = axis;
+        if (cell < 0 || cell >= dims[axis]) p.active[lane] = false;
+    }
+}
+
+#ifdef RAYCAST_SIMD
+/*traverseLane for all 8 lanes at once, stepping every active lane each
+iteration & masking updates to active lanes. Returns with lanes' state written
+back once no more than idle lanes are still active, so finished lanes can be
+given new rays, or once a lane still looking for a block is in an empty cell of
+the occupancy pyramid's MIN_SKIP_LEVEL, for skipCell. Lanes that hit keep
+stepping until then, with where they hit kept aside, so the next step never
+waits on a gather. Blocks are gathered as 32 bit words from their byte's
+address, so Map pads its blocks by MAP_PADDING.*/
+__attribute__((target("avx2")))
+static void traversePacketAVX2(const Map& map, RayPacket& p, float end, int idle)
+{
+    const int *blocks = (const int*)map.getBlocks();
+    int xDim = map.getXDim(), yDim = map.getYDim(), zDim = map.getZDim();
+    __m256i dimX = _mm256_set1_epi32(xDim), dimY = _mm256_set1_epi32(yDim), dimZ = _mm256_set1_epi32(zDim);
+    __m256i strideY = _mm256_set1_epi32(xDim * zDim), strideZ = dimX;
+    __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi32(-1), lowByte = _mm256_set1_epi32(0xFF);
+    __m256 endV = _mm256_set1_ps(end);
+    //Cells of the smallest level skipped, if the map has it
+    const int *cells = NULL;
+    __m256i cellStrideY = zero, cellStrideZ = zero;
+    if (map.getOccupancyLevels() > MIN_SKIP_LEVEL) {
+        glm::ivec3 dims = map.getOccupancyDims(MIN_SKIP_LEVEL);
+        cells = (const int*)map.getOccupancy(MIN_SKIP_LEVEL);
+        cellStrideY = _mm256_set1_epi32(dims.x * dims.z);
+        cellStrideZ = _mm256_set1_epi32(dims.x);
+    }
+
+    __m256i cx = _mm256_loadu_si256((const __m256i*)p.cell[0]);
+    __m256i cy = _mm256_loadu_si256((const __m256i*)p.cell[1]);
+    __m256i cz = _mm256_loadu_si256((const __m256i*)p.cell[2]);
+    __m256i sx = _mm256_loadu_si256((const __m256i*)p.step[0]);
+    __m256i sy = _mm256_loadu_si256((const __m256i*)p.step[1]);
+    __m256i sz = _mm256_loadu_si256((const __m256i*)p.step[2]);
+    __m256 nx = _mm256_loadu_ps(p.next[0]), ny = _mm256_loadu_ps(p.next[1]), nz = _mm256_loadu_ps(p.next[2]);
+    __m256 ox = _mm256_loadu_ps(p.origin[0]), oy = _mm256_loadu_ps(p.origin[1]), oz = _mm256_loadu_ps(p.origin[2]);
+    __m256 ix = _mm256_loadu_ps(p.inverse[0]), iy = _mm256_loadu_ps(p.inverse[1]), iz = _mm256_loadu_ps(p.inverse[2]);
+    //Added to a block to give the boundary it leaves through, as planeDistance
+    __m256i offsetX = _mm256_srli_epi32(_mm256_cmpgt_epi32(sx, zero), 31);
+    __m256i offsetY = _mm256_srli_epi32(_mm256_cmpgt_epi32(sy, zero), 31);
+    __m256i offsetZ = _mm256_srli_epi32(_mm256_cmpgt_epi32(sz, zero), 31);
+    __m256 t = _mm256_loadu_ps(p.t);
+    __m256i axis = _mm256_loadu_si256((const __m256i*)p.axis);
+    __m256i active = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p.active)), zero);
+    //Lanes that have hit, & their block, distance & axis when they did
+    __m256i hit = zero;
+    __m256i hx = cx, hy = cy, hz = cz, hAxis = axis;
+    __m256 hT = t;
+
+    while (__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(hit, active)))) > idle) {
+        __m256i index = _mm256_add_epi32(cx, _mm256_add_epi32(_mm256_mullo_epi32(cy, strideY),
+            _mm256_mullo_epi32(cz, strideZ)));
+        __m256i solid = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, blocks, index, active, 1), lowByte);
+        __m256i found = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(solid, zero), hit), active);
+        hit = _mm256_or_si256(hit, found);
+        hx = _mm256_blendv_epi8(hx, cx, found);
+        hy = _mm256_blendv_epi8(hy, cy, found);
+        hz = _mm256_blendv_epi8(hz, cz, found);
+        hAxis = _mm256_blendv_epi8(hAxis, axis, found);
+        hT = _mm256_blendv_ps(hT, t, _mm256_castsi256_ps(found));
+        if (cells) {
+            __m256i searching = _mm256_andnot_si256(hit, active);
+            __m256i cell = _mm256_add_epi32(_mm256_srli_epi32(cx, MIN_SKIP_LEVEL), _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_srli_epi32(cy, MIN_SKIP_LEVEL), cellStrideY),
+                _mm256_mullo_epi32(_mm256_srli_epi32(cz, MIN_SKIP_LEVEL), cellStrideZ)));
+            __m256i empty = _mm256_cmpeq_epi32(_mm256_mask_i32gather_epi32(ones, cells, cell, searching, 4), zero);
+            if (!_mm256_testz_si256(empty, searching)) break;
+        }
+
+        //Nearest boundary, ties broken as traverseLane
+        __m256i xy = _mm256_castps_si256(_mm256_cmp_ps(nx, ny, _CMP_LE_OQ));
+        __m256i xz = _mm256_castps_si256(_mm256_cmp_ps(nx, nz, _CMP_LE_OQ));
+        __m256i yz = _mm256_castps_si256(_mm256_cmp_ps(ny, nz, _CMP_LE_OQ));
+        __m256i selX = _mm256_and_si256(xy, xz);
+        __m256i selY = _mm256_andnot_si256(xy, yz);
+        __m256i selZ = _mm256_andnot_si256(_mm256_or_si256(selX, selY), ones);
+        __m256 tNext = _mm256_blendv_ps(_mm256_blendv_ps(nz, ny, _mm256_castsi256_ps(selY)), nx,
+            _mm256_castsi256_ps(selX));
+        active = _mm256_andnot_si256(_mm256_castps_si256(_mm256_cmp_ps(tNext, endV, _CMP_GT_OQ)), active);
+
+        selX = _mm256_and_si256(selX, active);
+        selY = _mm256_and_si256(selY, active);
+        selZ = _mm256_and_si256(selZ, active);
+        cx = _mm256_add_epi32(cx, _mm256_and_si256(sx, selX));
+        cy = _mm256_add_epi32(cy, _mm256_and_si256(sy, selY));
+        cz = _mm256_add_epi32(cz, _mm256_and_si256(sz, selZ));
+        nx = _mm256_blendv_ps(nx, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(cx, offsetX)), ox), ix),
+            _mm256_castsi256_ps(selX));
+        ny = _mm256_blendv_ps(ny, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(cy, offsetY)), oy), iy),
+            _mm256_castsi256_ps(selY));
+        nz = _mm256_blendv_ps(nz, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(cz, offsetZ)), oz), iz),
+            _mm256_castsi256_ps(selZ));
+        t = _mm256_blendv_ps(t, tNext, _mm256_castsi256_ps(active));
+        __m256i stepped = _mm256_or_si256(_mm256_and_si256(selY, _mm256_set1_epi32(1)),
+            _mm256_and_si256(selZ, _mm256_set1_epi32(2)));
+        axis = _mm256_blendv_epi8(axis, stepped, active);
+
+        //Still in the map on every axis
+        __m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(cx, ones), _mm256_cmpgt_epi32(dimX, cx));
+        inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(cy, ones), _mm256_cmpgt_epi32(dimY, cy)));
+        inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(cz, ones), _mm256_cmpgt_epi32(dimZ, cz)));
+        active = _mm256_and_si256(active, inside);
+    }
+
+    _mm256_storeu_si256((__m256i*)p.cell[0], _mm256_blendv_epi8(cx, hx, hit));
+    _mm256_storeu_si256((__m256i*)p.cell[1], _mm256_blendv_epi8(cy, hy, hit));
+    _mm256_storeu_si256((__m256i*)p.cell[2], _mm256_blendv_epi8(cz, hz, hit));
+    _mm256_storeu_ps(p.next[0], nx);
+    _mm256_storeu_ps(p.next[1], ny);
+    _mm256_storeu_ps(p.next[2], nz);
+    _mm256_storeu_ps(p.t, _mm256_blendv_ps(t, hT, _mm256_castsi256_ps(hit)));
+    _mm256_storeu_si256((__m256i*)p.axis, _mm256_blendv_epi8(axis, hAxis, hit));
+    int hits = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+    int actives = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(hit, active)));
+    _mm256_zeroupper();
+    for (int lane = 0; lane < RAY_PACKET; lane++) {
+        p.hit[lane] = hits >> lane & 1;
+        p.active[lane] = actives >> lane & 1;
+    }
+}
+#endif
+
+static void writeHit(const RayPacket& p, int lane, RayHit& hit)
+{
+    hit.block = {p.cell[0][lane], p.cell[1][lane], p.cell[2][lane]};
+    hit.normal = {0, 0, 0};
+    hit.side = -1;
+    hit.distance = p.hit[lane] ? p.t[lane] : INFINITY;
+    int axis = p.axis[lane];
+    if (!p.hit[lane] || axis < 0) return;
+    hit.normal[axis] = -p.step[axis][lane];
+    hit.side = entrySides[axis][p.step[axis][lane] < 0];
+}
+
+bool raycast(const Map& map, glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit)
+{
+    RayPacket p;
+    setupLane(map, origin, direction, maxDistance, p, 0);
+    traverseLane(map, p, 0, maxDistance);
+    writeHit(p, 0, hit);
+    return p.hit[0];
+}
+
+static void castRays(const Map& map, const glm::vec3 *origins, const glm::vec3 *directions, int count,
+    float maxDistance, RayHit *hits)
+{
+    RayPacket p = {};
+#ifdef RAYCAST_SIMD
+    if (getSimdIsa() >= SimdIsa::AVX2) {
+        /*Rays are streamed through the packet: once half its lanes are done
+        they're written out & given the next rays, so lanes don't sit idle
+        waiting on the packet's longest ray. Lanes the packet stops in empty
+        cells skip them here, as traverseLane would.*/
+        int dims[3] = {(int)map.getXDim(), (int)map.getYDim(), (int)map.getZDim()};
+        int rays[RAY_PACKET];
+        int next = 0;
+        for (int lane = 0; lane < RAY_PACKET; lane++) {
+            rays[lane] = -1;
+            p.active[lane] = p.hit[lane] = false;
+        }
+        while (true) {
+            int active = 0;
+            for (int lane = 0; lane < RAY_PACKET; lane++) {
+                while (true) {
+                    int level;
+                    while (p.active[lane] && (level = emptyLevel(map, p, lane)) >= MIN_SKIP_LEVEL)
+                        skipCell(p, lane, level, maxDistance, dims);
+                    if (p.active[lane]) break;
+                    if (rays[lane] >= 0) writeHit(p, lane, hits[rays[lane]]);
+                    rays[lane] = -1;
+                    if (next == count) break;
+                    setupLane(map, origins[next], directions[next], maxDistance, p, lane);
+                    rays[lane] = next++;
+                }
+                active += p.active[lane];
+            }
+            if (!active) return;
+            traversePacketAVX2(map, p, maxDistance, next < count ? RAY_PACKET / 2 : 0);
+        }
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        setupLane(map, origins[i], directions[i], maxDistance, p, 0);
+        traverseLane(map, p, 0, maxDistance);
+        writeHit(p, 0, hits[i]);
+    }
+}
+
+void raycastBatch(const Map& map, const glm::vec3 *origins, const glm::vec3 *directions, int count,
+    float maxDistance, RayHit *hits)
+{
+    castRays(map, origins, directions, count, maxDistance, hits);
+}
+
+void raycastBatch(const Map& map, const glm::vec3 *origins, const glm::vec3 *directions, int count,
+    float maxDistance, RayHit *hits, ThreadPool& pool)
+{
+    pool.parallelFor((count + RAY_TASK - 1) / RAY_TASK, [&](int task, int) {
+        int first = task * RAY_TASK;
+        castRays(map, origins + first, directions + first, std::min(count - first, RAY_TASK), maxDistance,
+            hits + first);
+    });
+}
@@ -0,0 +1,406 @@
+#include "renderer.h"
+#include <iostream>
+#include <cstddef>
+#include <cfloat>
+
+#include "glad/glad.h"
+#include "glm/gtc/type_ptr.hpp"
+
+#include "shaders.h"
+#include "frustum.h"
+#include "simd.h"
+
+//Visible chunks recorded per pool task
+#define RECORD_BATCH 16
+
+unsigned int compileShader(const char *vertexShaderSource, const char *fragmentShaderSource);
+
+//Square vertices, left face
+static const float square[] = {
+    //xyz coords            //texture coords
+    -0.5f,  0.5f,   0.5f,   1.0f,   0.0f,
+    -0.5f,  0.5f,   -0.5f,  0.0f,   0.0f,
+    -0.5f,  -0.5f,  -0.5f,  0.0f,   1.0f,
+    -0.5f,  -0.5f,  -0.5f,  0.0f,   1.0f,
+    -0.5f,  -0.5f,  0.5f,   1.0f,   1.0f,
+    -0.5f,  0.5f,   0.5f,   1.0f,   0.0f
+};
+
+Renderer::Renderer(int width, int height)
+        : _boundProgram(), _boundVAO(), _boundTexture(), _uploader(), _uploadsInFlight(), _uploadBudget(16),
+        _callCounter(), _frameCalls(), _frameDraws(), _totalCalls(), _cameraData() {
+    //Block shader, locations looked up once
+    _program = compileShader(blockVert, blockFrag);
+    unsigned int cameraIdx = glGetUniformBlockIndex(_program, "Camera");
+    glUniformBlockBinding(_program, cameraIdx, CAMERA_UBO_BINDING);
+    _samplerLoc = glGetUniformLocation(_program, "txtr");
+    useProgram(_program);
+    glUniform1i(_samplerLoc, 0);
+
+    //Camera uniform buffer, stays bound to both the generic and indexed binding points
+    glGenBuffers(1, &_cameraUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, _cameraUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UBO_BINDING, _cameraUBO);
+
+    //Square vertices, shared by every chunk's vertex array
+    glGenBuffers(1, &_squareVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, _squareVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(square), square, GL_STATIC_DRAW);
+
+    //Set up texture
+    glGenTextures(1, &_texture);
+    bindTexture(_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    //Setting state variables
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    //Set background to sky blue :-)
+    glClearColor(0.8f, 1.0f, 1.0f, 1.0f);
+}
+
+Renderer::~Renderer()
+{
+    //Transfers the stopped worker finished but weren't taken yet are deleted with the rest
+    UploadResult result;
+    while (_uploader && _uploader->pop(result)) _completedUploads.push_back(result);
+    for (UploadResult& completed : _completedUploads) {
+        glDeleteSync((GLsync)completed.fence);
+        if (completed.job.type == UploadType::TextureUpload) glDeleteTextures(1, &completed.object);
+        else glDeleteBuffers(1, &completed.object);
+    }
+    for (ChunkMesh& mesh : _chunks) {
+        if (!mesh.vao) continue;
+        glDeleteVertexArrays(1, &mesh.vao);
+        glDeleteBuffers(1, &mesh.ibo);
+    }
+    glDeleteBuffers(1, &_squareVBO);
+    glDeleteBuffers(1, &_cameraUBO);
+    glDeleteTextures(1, &_texture);
+    glDeleteProgram(_program);
+}
+
+void Renderer::setProjection(const glm::mat4& projection)
+{
+    //Projection rarely changes, so it is only uploaded here rather than every frame
+    _cameraData.projection = projection;
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraBlock, projection), sizeof(glm::mat4), glm::value_ptr(projection));
+    countCall();
+}
+
+void Renderer::uploadChunk(int chunk, unsigned long version, int topCount, const std::vector<SquareData>& instances)
+{
+    if (chunk >= (int)_chunks.size()) _chunks.resize(chunk + 1, ChunkMesh());
+    ChunkMesh& mesh = _chunks[chunk];
+    //Skip meshes already uploaded, snapshots repeat updates until acknowledged
+    if (mesh.vao && version <= mesh.version) return;
+
+    unsigned int ibo = mesh.ibo;
+    if (!ibo) {
+        glGenBuffers(1, &ibo);
+        countCall();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(SquareData), instances.data(), GL_STATIC_DRAW);
+    countCall(2);
+    attachInstances(mesh, ibo);
+    mesh.count = instances.size();
+    mesh.topCount = topCount;
+    mesh.version = version;
+
+    //Bounds for culling on the render thread, squares extend half a block from their block's center
+    mesh.min = glm::vec3(FLT_MAX);
+    mesh.max = glm::vec3(-FLT_MAX);
+    for (const SquareData& square : instances) {
+        glm::vec3 pos = {square.pos[0], square.pos[1], square.pos[2]};
+        mesh.min = glm::min(mesh.min, pos);
+        mesh.max = glm::max(mesh.max, pos + 1.0f);
+    }
+}
+
+void Renderer::attachInstances(ChunkMesh& mesh, unsigned int ibo)
+{
+    if (!mesh.vao) {
+        //Generate VAO, square vertices are shared by every chunk
+        glGenVertexArrays(1, &mesh.vao);
+        bindVertexArray(mesh.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _squareVBO);
+
+        //Vertex positon
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        //Texture coords
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        //Instance attributes advance once per square
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(4, 1);
+        glEnableVertexAttribArray(4);
+        countCall(12);
+    }
+    bindVertexArray(mesh.vao);
+
+    //Point instance attributes at the (possibly new) instance buffer
+    glBindBuffer(GL_ARRAY_BUFFER, ibo);
+    //Block Position
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SquareData), (void*)0);
+    //Block type
+    glVertexAttribIPointer(3, 1, GL_INT, sizeof(SquareData), (void*)(sizeof(int)*3));
+    //Side
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(SquareData), (void*)(4*sizeof(int)));
+    countCall(4);
+
+    //Buffers replaced by the upload worker are released once the VAO no longer uses them
+    if (mesh.ibo && mesh.ibo != ibo) {
+        glDeleteBuffers(1, &mesh.ibo);
+        countCall();
+    }
+    mesh.ibo = ibo;
+}
+
+void Renderer::queueChunk(const PendingUpload& upload)
+{
+    if (upload.chunk < (int)_chunks.size() && _chunks[upload.chunk].vao
+        && upload.version <= _chunks[upload.chunk].version) return;
+    for (PendingUpload& queued : _uploadQueue) {
+        if (queued.chunk != upload.chunk) continue;
+        if (upload.version > queued.version) queued = upload;
+        return;
+    }
+    _uploadQueue.push_back(upload);
+}
+
+void Renderer::queueTexture(std::shared_ptr<const unsigned char> pixels, int width, int height)
+{
+    if (!_uploader) {
+        uploadTexture(pixels.get(), width, height);
+        return;
+    }
+    UploadJob job = {};
+    job.type = UploadType::TextureUpload;
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    if (_uploader->push(job)) _uploadsInFlight++;
+}
+
+void Renderer::processUploads()
+{
+    if (!_uploader) {
+        int count = glm::min((int)_uploadQueue.size(), _uploadBudget);
+        for (int i = 0; i < count; i++) {
+            const PendingUpload& upload = _uploadQueue[i];
+            uploadChunk(upload.chunk, upload.version, upload.topCount, *upload.instances);
+        }
+        _uploadQueue.erase(_uploadQueue.begin(), _uploadQueue.begin() + count);
+        return;
+    }
+
+    //Take finished transfers, then use those whose fences have signalled, never waiting on any
+    UploadResult result;
+    while (_uploader->pop(result)) _completedUploads.push_back(result);
+    size_t kept = 0;
+    for (size_t i = 0; i < _completedUploads.size(); i++) {
+        UploadResult& completed = _completedUploads[i];
+        GLenum status = glClientWaitSync((GLsync)completed.fence, 0, 0);
+        countCall();
+        if (status == GL_TIMEOUT_EXPIRED) {
+            _completedUploads[kept++] = completed;
+            continue;
+        }
+        glDeleteSync((GLsync)completed.fence);
+        countCall();
+        finishUpload(completed);
+        _uploadsInFlight--;
+    }
+    _completedUploads.resize(kept);
+
+    //Hand queued meshes to the worker, the budget bounds transfers in flight
+    size_t sent = 0;
+    while (sent < _uploadQueue.size() && _uploadsInFlight < _uploadBudget) {
+        const PendingUpload& upload = _uploadQueue[sent];
+        UploadJob job = {};
+        job.type = UploadType::ChunkUpload;
+        job.chunk = upload.chunk;
+        job.version = upload.version;
+        job.topCount = upload.topCount;
+        job.instances = upload.instances;
+        if (!_uploader->push(job)) break;
+        _uploadsInFlight++;
+        sent++;
+    }
+    _uploadQueue.erase(_uploadQueue.begin(), _uploadQueue.begin() + sent);
+}
+
+void Renderer::finishUpload(const UploadResult& result)
+{
+    const UploadJob& job = result.job;
+    if (job.type == UploadType::TextureUpload) {
+        glDeleteTextures(1, &_texture);
+        countCall();
+        _texture = result.object;
+        return;
+    }
+
+    if (job.chunk >= (int)_chunks.size()) _chunks.resize(job.chunk + 1, ChunkMesh());
+    ChunkMesh& mesh = _chunks[job.chunk];
+    //A newer version finished first, discard this one
+    if (mesh.vao && job.version <= mesh.version) {
+        unsigned int object = result.object;
+        glDeleteBuffers(1, &object);
+        countCall();
+        return;
+    }
+    attachInstances(mesh, result.object);
+    mesh.count = job.instances->size();
+    mesh.topCount = job.topCount;
+    mesh.version = job.version;
+    mesh.min = result.min;
+    mesh.max = result.max;
+}
+
+void Renderer::uploadTexture(const unsigned char *data, int width, int height)
+{
+    bindTexture(_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    countCall(2);
+}
+
+void Renderer::recordChunks(ThreadPool& pool, const glm::mat4& view, const std::vector<VisibleChunk>& chunks,
+    CommandBuffer& commands) const
+{
+    commands.reset(pool.getThreadCount());
+    Frustum frustum = frustumFromMatrix(_cameraData.projection * view);
+    glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    int tasks = (chunks.size() + RECORD_BATCH - 1) / RECORD_BATCH;
+    pool.parallelFor(tasks, [&](int task, int worker) {
+        size_t begin = task * RECORD_BATCH, end = glm::min(chunks.size(), begin + RECORD_BATCH);
+        //The batch's mesh bounds, each coordinate in turn, tested against the frustum together
+        float bounds[6][RECORD_BATCH];
+        bool inside[RECORD_BATCH];
+        int n = 0;
+        for (size_t i = begin; i < end; i++) {
+            if (chunks[i].chunk >= (int)_chunks.size()) continue;
+            const ChunkMesh& mesh = _chunks[chunks[i].chunk];
+            for (int j = 0; j < 3; j++) {
+                bounds[j][n] = mesh.min[j];
+                bounds[j + 3][n] = mesh.max[j];
+            }
+            n++;
+        }
+        simdKernels().boxesInFrustum(frustum, bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5], n,
+            inside);
+        n = 0;
+        for (size_t i = begin; i < end; i++) {
+            const VisibleChunk& visible = chunks[i];
+            if (visible.chunk >= (int)_chunks.size()) continue;
+            if (!inside[n++]) continue;
+            const ChunkMesh& mesh = _chunks[visible.chunk];
+            //Distant chunks only up to their last top face
+            unsigned int count = visible.lod == ChunkLod::TopsOnly ? mesh.topCount : mesh.count;
+            if (!count) continue;
+            float depth = glm::distance(eye, glm::clamp(eye, mesh.min, mesh.max));
+            commands.record(worker, {drawKey(_program, _texture, depth, visible.chunk), _program, _texture, mesh.vao, count});
+        }
+    });
+}
+
+void Renderer::drawFrame(const glm::mat4& view, CommandBuffer& commands)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    countCall();
+
+    //Only the view matrix changes per frame, camera UBO is never unbound
+    _cameraData.view = view;
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraBlock, view), sizeof(glm::mat4), glm::value_ptr(view));
+    countCall();
+
+    //Packets arrive grouped by state, so binds are only issued when the state changes
+    const std::vector<DrawPacket>& packets = commands.merge();
+    for (const DrawPacket& packet : packets) {
+        useProgram(packet.program);
+        bindTexture(packet.texture);
+        bindVertexArray(packet.vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, packet.instances);
+        countCall();
+    }
+
+    //Frame count includes any uploads made since the last frame
+    _frameCalls = _callCounter;
+    _frameDraws = packets.size();
+    _totalCalls += _callCounter;
+    _callCounter = 0;
+}
+
+void Renderer::useProgram(unsigned int program)
+{
+    if (program == _boundProgram) return;
+    glUseProgram(program);
+    countCall();
+    _boundProgram = program;
+}
+
+void Renderer::bindVertexArray(unsigned int vao)
+{
+    if (vao == _boundVAO) return;
+    glBindVertexArray(vao);
+    countCall();
+    _boundVAO = vao;
+}
+
+void Renderer::bindTexture(unsigned int texture)
+{
+    if (texture == _boundTexture) return;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    countCall();
+    _boundTexture = texture;
+}
+
+//Shader compiling utility function, adapted from Learn OpenGL by Joey de Vries
+unsigned int compileShader(const char *vertexShaderSource, const char *fragmentShaderSource) {
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glCompileShader(vertexShader);
+
+    int success;
+    char infoLog[512];
+
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glCompileShader(fragmentShader);
+
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, fragmentShader);
+    glAttachShader(shaderProgram, vertexShader);
+
+    glLinkProgram(shaderProgram);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    return shaderProgram;
+}
@@ -0,0 +1,258 @@
+#include "simd.h"
+#include <string.h>
+
+#include "gradientnoise.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_SIMD
+#include <immintrin.h>
+#endif
+
+static void faceMasksScalar(const bool *row, const bool *back, const bool *front, const bool *above,
+        const bool *below, int count, uint8_t *masks) {
+    for (int i = 0; i < count; i++) {
+        bool solid = row[i + 1];
+        masks[i] = (solid && !row[i]) | (solid && !below[i]) << 1 | (solid && !above[i]) << 2
+            | (solid && !row[i + 2]) << 3 | (solid && !front[i]) << 4 | (solid && !back[i]) << 5;
+    }
+}
+
+static void boxesInFrustumScalar(const Frustum& f, const float *minX, const float *minY, const float *minZ,
+        const float *maxX, const float *maxY, const float *maxZ, int count, bool *inside) {
+    for (int i = 0; i < count; i++)
+        inside[i] = aabbInFrustum(f, {minX[i], minY[i], minZ[i]}, {maxX[i], maxY[i], maxZ[i]});
+}
+
+static bool anySolidScalar(const bool *blocks, int count) {
+    for (int i = 0; i < count; i++)
+        if (blocks[i]) return true;
+    return false;
+}
+
+static void verletStepScalar(float *velocity, float *acceleration, const uint8_t *flags, float gravity,
+        float timeStep, int count, float *rise) {
+    for (int i = 0; i < count; i++) {
+        float v = velocity[i], a = acceleration[i];
+        float next = flags[i] & 1 ? 0.0f : -gravity;
+        rise[i] = v * timeStep + a * (timeStep * timeStep * 0.5f);
+        velocity[i] = v + (a + next) * (timeStep * 0.5f);
+        acceleration[i] = next;
+    }
+}
+
+#ifdef KERNELS_SIMD
+/*16 blocks at a time, blocks are bytes of 0 or 1. A face is visible where the
+block is 1 & its neighbour 0, which andnot gives as 1, shifted to the face's
+bit. Chunk rows are 16 blocks, so wider registers wouldn't help.*/
+__attribute__((target("sse4.1")))
+static void faceMasksSSE41(const bool *row, const bool *back, const bool *front, const bool *above,
+        const bool *below, int count, uint8_t *masks) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i solid = _mm_loadu_si128((const __m128i*)(row + i + 1));
+        __m128i m = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)(row + i)), solid);
+        m = _mm_or_si128(m, _mm_slli_epi16(_mm_andnot_si128(_mm_loadu_si128((const __m128i*)(below + i)), solid), 1));
+        m = _mm_or_si128(m, _mm_slli_epi16(_mm_andnot_si128(_mm_loadu_si128((const __m128i*)(above + i)), solid), 2));
+        m = _mm_or_si128(m, _mm_slli_epi16(_mm_andnot_si128(_mm_loadu_si128((const __m128i*)(row + i + 2)), solid), 3));
+        m = _mm_or_si128(m, _mm_slli_epi16(_mm_andnot_si128(_mm_loadu_si128((const __m128i*)(front + i)), solid), 4));
+        m = _mm_or_si128(m, _mm_slli_epi16(_mm_andnot_si128(_mm_loadu_si128((const __m128i*)(back + i)), solid), 5));
+        _mm_storeu_si128((__m128i*)(masks + i), m);
+    }
+    faceMasksScalar(row + i, back + i, front + i, above + i, below + i, count - i, masks + i);
+}
+
+/*Planes are tested against several boxes at once. The corner furthest along a
+plane's normal takes each coordinate from the min or max array by the sign of
+the normal, the same for every box. Same operations in the same order as
+aabbInFrustum, simd.cpp is built without FMA contraction.*/
+__attribute__((target("sse4.1")))
+static void boxesInFrustumSSE41(const Frustum& f, const float *minX, const float *minY, const float *minZ,
+        const float *maxX, const float *maxY, const float *maxZ, int count, bool *inside) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 outside = _mm_setzero_ps();
+        for (const glm::vec4& p : f.planes) {
+            __m128 vx = _mm_loadu_ps((p.x >= 0 ? maxX : minX) + i);
+            __m128 vy = _mm_loadu_ps((p.y >= 0 ? maxY : minY) + i);
+            __m128 vz = _mm_loadu_ps((p.z >= 0 ? maxZ : minZ) + i);
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), vx), _mm_mul_ps(_mm_set1_ps(p.y), vy));
+            d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), vz)), _mm_set1_ps(p.w));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+        }
+        int bits = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) inside[i + k] = !(bits >> k & 1);
+    }
+    boxesInFrustumScalar(f, minX + i, minY + i, minZ + i, maxX + i, maxY + i, maxZ + i, count - i, inside + i);
+}
+
+__attribute__((target("avx2")))
+static void boxesInFrustumAVX2(const Frustum& f, const float *minX, const float *minY, const float *minZ,
+        const float *maxX, const float *maxY, const float *maxZ, int count, bool *inside) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 outside = _mm256_setzero_ps();
+        for (const glm::vec4& p : f.planes) {
+            __m256 vx = _mm256_loadu_ps((p.x >= 0 ? maxX : minX) + i);
+            __m256 vy = _mm256_loadu_ps((p.y >= 0 ? maxY : minY) + i);
+            __m256 vz = _mm256_loadu_ps((p.z >= 0 ? maxZ : minZ) + i);
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x), vx), _mm256_mul_ps(_mm256_set1_ps(p.y), vy));
+            d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z), vz)), _mm256_set1_ps(p.w));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        int bits = _mm256_movemask_ps(outside);
+        for (int k = 0; k < 8; k++) inside[i + k] = !(bits >> k & 1);
+    }
+    _mm256_zeroupper();
+    boxesInFrustumScalar(f, minX + i, minY + i, minZ + i, maxX + i, maxY + i, maxZ + i, count - i, inside + i);
+}
+
+__attribute__((target("avx512f")))
+static void boxesInFrustumAVX512(const Frustum& f, const float *minX, const float *minY, const float *minZ,
+        const float *maxX, const float *maxY, const float *maxZ, int count, bool *inside) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __mmask16 outside = 0;
+        for (const glm::vec4& p : f.planes) {
+            __m512 vx = _mm512_loadu_ps((p.x >= 0 ? maxX : minX) + i);
+            __m512 vy = _mm512_loadu_ps((p.y >= 0 ? maxY : minY) + i);
+            __m512 vz = _mm512_loadu_ps((p.z >= 0 ? maxZ : minZ) + i);
+            __m512 d = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(p.x), vx), _mm512_mul_ps(_mm512_set1_ps(p.y), vy));
+            d = _mm512_add_ps(_mm512_add_ps(d, _mm512_mul_ps(_mm512_set1_ps(p.z), vz)), _mm512_set1_ps(p.w));
+            outside |= _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_LT_OQ);
+        }
+        for (int k = 0; k < 16; k++) inside[i + k] = !(outside >> k & 1);
+    }
+    _mm256_zeroupper();
+    boxesInFrustumScalar(f, minX + i, minY + i, minZ + i, maxX + i, maxY + i, maxZ + i, count - i, inside + i);
+}
+
+//Next acceleration is -gravity masked by flags' Grounded bit being clear, so grounded bodies get +0 as scalar
+__attribute__((target("sse4.1")))
+static void verletStepSSE41(float *velocity, float *acceleration, const uint8_t *flags, float gravity,
+        float timeStep, int count, float *rise) {
+    __m128 dt = _mm_set1_ps(timeStep), halfDt2 = _mm_set1_ps(timeStep * timeStep * 0.5f);
+    __m128 halfDt = _mm_set1_ps(timeStep * 0.5f), fall = _mm_set1_ps(-gravity);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int bytes;
+        memcpy(&bytes, flags + i, 4);
+        __m128i grounded = _mm_and_si128(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)), _mm_set1_epi32(1));
+        __m128 next = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(grounded, _mm_setzero_si128())), fall);
+        __m128 v = _mm_loadu_ps(velocity + i), a = _mm_loadu_ps(acceleration + i);
+        _mm_storeu_ps(rise + i, _mm_add_ps(_mm_mul_ps(v, dt), _mm_mul_ps(a, halfDt2)));
+        _mm_storeu_ps(velocity + i, _mm_add_ps(v, _mm_mul_ps(_mm_add_ps(a, next), halfDt)));
+        _mm_storeu_ps(acceleration + i, next);
+    }
+    verletStepScalar(velocity + i, acceleration + i, flags + i, gravity, timeStep, count - i, rise + i);
+}
+
+__attribute__((target("avx2")))
+static void verletStepAVX2(float *velocity, float *acceleration, const uint8_t *flags, float gravity,
+        float timeStep, int count, float *rise) {
+    __m256 dt = _mm256_set1_ps(timeStep), halfDt2 = _mm256_set1_ps(timeStep * timeStep * 0.5f);
+    __m256 halfDt = _mm256_set1_ps(timeStep * 0.5f), fall = _mm256_set1_ps(-gravity);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i grounded = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(flags + i))),
+            _mm256_set1_epi32(1));
+        __m256 next = _mm256_and_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(grounded, _mm256_setzero_si256())), fall);
+        __m256 v = _mm256_loadu_ps(velocity + i), a = _mm256_loadu_ps(acceleration + i);
+        _mm256_storeu_ps(rise + i, _mm256_add_ps(_mm256_mul_ps(v, dt), _mm256_mul_ps(a, halfDt2)));
+        _mm256_storeu_ps(velocity + i, _mm256_add_ps(v, _mm256_mul_ps(_mm256_add_ps(a, next), halfDt)));
+        _mm256_storeu_ps(acceleration + i, next);
+    }
+    _mm256_zeroupper();
+    verletStepScalar(velocity + i, acceleration + i, flags + i, gravity, timeStep, count - i, rise + i);
+}
+
+__attribute__((target("sse4.1")))
+static bool anySolidSSE41(const bool *blocks, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(blocks + i));
+        if (!_mm_testz_si128(v, v)) return true;
+    }
+    return anySolidScalar(blocks + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static bool anySolidAVX2(const bool *blocks, int count) {
+    int i = 0;
+    bool found = false;
+    for (; i + 32 <= count && !found; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(blocks + i));
+        found = !_mm256_testz_si256(v, v);
+    }
+    _mm256_zeroupper();
+    return found || anySolidScalar(blocks + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static bool anySolidAVX512(const bool *blocks, int count) {
+    int i = 0;
+    bool found = false;
+    //Any nonzero byte makes its 32 bit lane nonzero
+    for (; i + 64 <= count && !found; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(blocks + i));
+        found = _mm512_test_epi32_mask(v, v) != 0;
+    }
+    _mm256_zeroupper();
+    return found || anySolidScalar(blocks + i, count - i);
+}
+#endif
+
+SimdIsa detectSimdIsa() {
+    static SimdIsa detected = []() {
+#ifdef KERNELS_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SimdIsa::AVX512;
+        if (__builtin_cpu_supports("avx2")) return SimdIsa::AVX2;
+        if (__builtin_cpu_supports("sse4.1")) return SimdIsa::SSE41;
+#endif
+        return SimdIsa::Scalar;
+    }();
+    return detected;
+}
+
+static SimdIsa boundIsa = SimdIsa::Scalar;
+static SimdKernels kernels = {faceMasksScalar, boxesInFrustumScalar, anySolidScalar, verletStepScalar};
+//Bound to the detected instruction set before main runs
+static bool bound = (setSimdIsa(detectSimdIsa()), true);
+
+void setSimdIsa(SimdIsa isa) {
+    boundIsa = isa < detectSimdIsa() ? isa : detectSimdIsa();
+    kernels = {faceMasksScalar, boxesInFrustumScalar, anySolidScalar, verletStepScalar};
+#ifdef KERNELS_SIMD
+    switch (boundIsa)
+    {
+    case SimdIsa::AVX512: kernels = {faceMasksSSE41, boxesInFrustumAVX512, anySolidAVX512, verletStepAVX2}; break;
+    case SimdIsa::AVX2: kernels = {faceMasksSSE41, boxesInFrustumAVX2, anySolidAVX2, verletStepAVX2}; break;
+    case SimdIsa::SSE41: kernels = {faceMasksSSE41, boxesInFrustumSSE41, anySolidSSE41, verletStepSSE41}; break;
+    default: break;
+    }
+#endif
+    bindNoiseKernels(boundIsa);
+}
+
+SimdIsa getSimdIsa() {
+    return boundIsa;
+}
+
+const SimdKernels& simdKernels() {
+    return kernels;
+}
+
+static const char *isaNames[] = {"scalar", "sse4.1", "avx2", "avx512"};
+
+const char *simdIsaName(SimdIsa isa) {
+    return isaNames[isa];
+}
+
+bool parseSimdIsa(const char *name, SimdIsa& isa) {
+    for (int i = SimdIsa::Scalar; i <= SimdIsa::AVX512; i++) {
+        if (strcmp(name, isaNames[i])) continue;
+        isa = (SimdIsa)i;
+        return true;
+    }
+    return false;
+}
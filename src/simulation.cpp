@@ -0,0 +1,231 @@
+#include "simulation.h"
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include "frustum.h"
+#include "simd.h"
+
+//Chunk bounds are grown by this much when culling, to cover interpolation between ticks
+#define CULL_MARGIN 1.0f
+
+double steadySeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Simulation::Simulation(Engine& engine, const glm::mat4& projection)
+        : _engine(engine), _projection(projection), _tickStep(engine.getTickStep()),
+        _mouseSensitivity(engine.getMouseSensitivity()), _latestInputTime(), _running(false), _ackedTick(0),
+        _farPlane(200.0f), _lodDistance(200.0f), _meshBudget(16), _initialMeshDone(false) {
+    const Map& map = engine.getMap();
+    _meshVersions.resize(map.getChunksX() * map.getChunksZ());
+    _faceCounts.resize(_meshVersions.size());
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start()
+{
+    _running = true;
+    _thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    _running = false;
+    if (_thread.joinable()) _thread.join();
+}
+
+bool Simulation::pushInput(const InputEvent& event)
+{
+    return _input.push(event);
+}
+
+const FrameSnapshot* Simulation::latestSnapshot()
+{
+    _snapshots.update();
+    //Tick 0 is never published, engine runs its first tick on construction
+    const FrameSnapshot& snapshot = _snapshots.readBuffer();
+    return snapshot.tick ? &snapshot : NULL;
+}
+
+void Simulation::acknowledge(unsigned long tick)
+{
+    _ackedTick.store(tick, std::memory_order_release);
+}
+
+void Simulation::setQuality(float farPlane, float lodDistance, int meshBudget)
+{
+    _farPlane.store(farPlane, std::memory_order_relaxed);
+    _lodDistance.store(lodDistance, std::memory_order_relaxed);
+    _meshBudget.store(meshBudget, std::memory_order_relaxed);
+}
+
+glm::mat4 Simulation::renderCamera(const FrameSnapshot& snapshot, double now) const
+{
+    //Interpolate across the tick following the snapshot
+    float alpha = glm::clamp(static_cast<float>((now - snapshot.tickTime) / _tickStep), 0.0f, 1.0f);
+    return cameraMatrix(glm::mix(snapshot.prevPosition, snapshot.position, alpha), snapshot.yaw, snapshot.pitch);
+}
+
+glm::mat4 Simulation::lateLatchedCamera(const FrameSnapshot& snapshot, double now, double cursorX, double cursorY) const
+{
+    if (!snapshot.cursorValid) return renderCamera(snapshot, now);
+    //Apply cursor movement the simulation hasn't seen yet, same as Engine::cursorMoved
+    float yaw = snapshot.yaw + static_cast<float>(cursorX - snapshot.cursorX) * _mouseSensitivity;
+    float pitch = glm::clamp(snapshot.pitch + static_cast<float>(snapshot.cursorY - cursorY) * _mouseSensitivity, -89.0f, 89.0f);
+    float alpha = glm::clamp(static_cast<float>((now - snapshot.tickTime) / _tickStep), 0.0f, 1.0f);
+    return cameraMatrix(glm::mix(snapshot.prevPosition, snapshot.position, alpha), yaw, pitch);
+}
+
+void Simulation::run()
+{
+    //Every chunk starts out needing a mesh, nearest are built first
+    for (size_t i = 0; i < _meshVersions.size(); i++) _meshBacklog.push_back(i);
+    remeshBacklog();
+
+    double last = steadySeconds();
+    double nextTick = last;
+    publish(last);
+    while (_running.load(std::memory_order_relaxed)) {
+        drainInput();
+        double now = steadySeconds();
+        unsigned long ticksBefore = _engine.getTickCount();
+        _engine.advance(now - last);
+        last = now;
+        if (_engine.getTickCount() != ticksBefore) {
+            _dirtyChunks.clear();
+            _engine.takeDirtyChunks(_dirtyChunks);
+            for (int chunk : _dirtyChunks)
+                if (std::find(_meshBacklog.begin(), _meshBacklog.end(), chunk) == _meshBacklog.end())
+                    _meshBacklog.push_back(chunk);
+            remeshBacklog();
+            publish(now);
+        }
+        //Sleep to the next tick boundary. If we've fallen behind, advance bounds the catch-up.
+        nextTick += _tickStep;
+        if (nextTick < now) nextTick = now;
+        std::this_thread::sleep_for(std::chrono::duration<double>(nextTick - steadySeconds()));
+    }
+}
+
+void Simulation::drainInput()
+{
+    InputEvent event;
+    while (_input.pop(event)) {
+        if (event.timestamp > _latestInputTime) _latestInputTime = event.timestamp;
+        switch (event.type)
+        {
+        case InputEventType::KeyEvent: _engine.setPlayerMoving(event.direction, event.pressed); break;
+        case InputEventType::CursorEvent: _engine.cursorMoved(event.x, event.y); break;
+        default: break;
+        }
+    }
+}
+
+void Simulation::remeshBacklog()
+{
+    const Map& map = _engine.getMap();
+    int chunksX = map.getChunksX();
+    glm::vec3 position = _engine.getPlayer().getCurrentPosition();
+    glm::vec2 player = {position.x, position.z};
+    //Nearest chunks first
+    std::sort(_meshBacklog.begin(), _meshBacklog.end(), [&](int a, int b) {
+        glm::vec2 ca = (glm::vec2(a % chunksX, a / chunksX) + 0.5f) * (float)CHUNK_SIZE;
+        glm::vec2 cb = (glm::vec2(b % chunksX, b / chunksX) + 0.5f) * (float)CHUNK_SIZE;
+        return glm::distance(ca, player) < glm::distance(cb, player);
+    });
+
+    int budget = glm::min((int)_meshBacklog.size(), _meshBudget.load(std::memory_order_relaxed));
+    for (int i = 0; i < budget; i++) {
+        int chunk = _meshBacklog[i];
+        std::shared_ptr<std::vector<SquareData>> instances = std::make_shared<std::vector<SquareData>>();
+        int tops = meshChunk(map, chunk % chunksX, chunk / chunksX, *instances);
+        _faceCounts[chunk] = instances->size();
+        ChunkMeshUpdate update = {chunk, ++_meshVersions[chunk], tops, _engine.getTickCount(), instances};
+        //Replace any update for the same chunk the renderer hasn't picked up yet
+        bool replaced = false;
+        for (ChunkMeshUpdate& u : _pendingMeshes) {
+            if (u.chunk != chunk) continue;
+            u = update;
+            replaced = true;
+        }
+        if (!replaced) _pendingMeshes.push_back(update);
+    }
+    _meshBacklog.erase(_meshBacklog.begin(), _meshBacklog.begin() + budget);
+
+    if (!_initialMeshDone && _meshBacklog.empty()) {
+        _initialMeshDone = true;
+        size_t faces = 0;
+        for (size_t count : _faceCounts) faces += count;
+        std::cout << faces << " visible faces.\r\n";
+    }
+}
+
+void Simulation::publish(double now)
+{
+    FrameSnapshot& snapshot = _snapshots.writeBuffer();
+    const Player& player = _engine.getPlayer();
+    snapshot.tick = _engine.getTickCount();
+    snapshot.tickTime = now;
+    snapshot.camera = _engine.getCamera();
+    snapshot.prevPosition = player.getPreviousPosition();
+    snapshot.position = player.getCurrentPosition();
+    snapshot.yaw = player.getYaw();
+    snapshot.pitch = _engine.getCamPitch();
+    snapshot.cursorValid = _engine.getLastCursor(snapshot.cursorX, snapshot.cursorY);
+    snapshot.latestInputTime = _latestInputTime;
+    snapshot.meshed = _initialMeshDone;
+
+    //Frustum & distance cull chunk columns, picking detail by distance
+    const Map& map = _engine.getMap();
+    Frustum frustum = frustumFromMatrix(_projection * snapshot.camera);
+    float farPlane = _farPlane.load(std::memory_order_relaxed);
+    float lodDistance = _lodDistance.load(std::memory_order_relaxed);
+    snapshot.visibleChunks.clear();
+    int chunks = map.getChunksX() * map.getChunksZ();
+    if (_chunkBounds.empty()) {
+        //Columns never change size, so bounds are laid out once
+        _chunkBounds.resize(6 * chunks);
+        _chunkInFrustum.reset(new bool[chunks]);
+        for (int chunk = 0; chunk < chunks; chunk++) {
+            int cx = chunk % map.getChunksX(), cz = chunk / map.getChunksX();
+            glm::vec3 min = {cx * CHUNK_SIZE, 0, cz * CHUNK_SIZE};
+            glm::vec3 max = {glm::min((cx + 1) * CHUNK_SIZE, (int)map.getXDim()), map.getYDim(),
+                glm::min((cz + 1) * CHUNK_SIZE, (int)map.getZDim())};
+            min -= CULL_MARGIN;
+            max += CULL_MARGIN;
+            for (int i = 0; i < 3; i++) {
+                _chunkBounds[i * chunks + chunk] = min[i];
+                _chunkBounds[(i + 3) * chunks + chunk] = max[i];
+            }
+        }
+    }
+    const float *bounds = _chunkBounds.data();
+    simdKernels().boxesInFrustum(frustum, bounds, bounds + chunks, bounds + 2 * chunks, bounds + 3 * chunks,
+        bounds + 4 * chunks, bounds + 5 * chunks, chunks, _chunkInFrustum.get());
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        if (!_chunkInFrustum[chunk]) continue;
+        glm::vec3 min = {bounds[chunk], bounds[chunks + chunk], bounds[2 * chunks + chunk]};
+        glm::vec3 max = {bounds[3 * chunks + chunk], bounds[4 * chunks + chunk], bounds[5 * chunks + chunk]};
+        //Distance from camera to nearest point of the chunk
+        float distance = glm::distance(snapshot.position, glm::clamp(snapshot.position, min, max));
+        if (distance > farPlane) continue;
+        ChunkLod lod = distance > lodDistance ? ChunkLod::TopsOnly : ChunkLod::Full;
+        snapshot.visibleChunks.push_back({chunk, lod});
+    }
+
+    //Drop mesh updates the renderer has seen, pass on the rest
+    unsigned long acked = _ackedTick.load(std::memory_order_acquire);
+    size_t kept = 0;
+    for (size_t i = 0; i < _pendingMeshes.size(); i++)
+        if (_pendingMeshes[i].tick > acked) _pendingMeshes[kept++] = _pendingMeshes[i];
+    _pendingMeshes.resize(kept);
+    snapshot.dirtyMeshes = _pendingMeshes;
+
+    _snapshots.publish();
+}
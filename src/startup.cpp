@@ -0,0 +1,92 @@
+#include "startup.h"
+#include <iostream>
+
+#include "simulation.h"
+
+StartupGraph::StartupGraph() : _origin(steadySeconds()), _finished() {}
+
+int StartupGraph::add(const std::string& name, std::function<bool()> fn, const std::vector<int>& dependencies,
+        bool mainThread)
+{
+    int id = _tasks.size();
+    _tasks.push_back({name, fn, {}, mainThread, (int)dependencies.size(), TaskState::Waiting, 0.0, 0.0});
+    for (int dependency : dependencies) _tasks[dependency].dependents.push_back(id);
+    return id;
+}
+
+bool StartupGraph::run(ThreadPool& pool)
+{
+    _finished = 0;
+    for (size_t i = 0; i < _tasks.size(); i++)
+        if (!_tasks[i].unfinished) launch(i, pool);
+
+    //Main thread tasks run here as they become ready, until every task is done
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_finished < (int)_tasks.size()) {
+        if (_mainReady.empty()) {
+            _changed.wait(lock);
+            continue;
+        }
+        int task = _mainReady.back();
+        _mainReady.pop_back();
+        lock.unlock();
+        execute(task, pool);
+        lock.lock();
+    }
+
+    bool succeeded = true;
+    for (const Task& task : _tasks) succeeded &= task.state == TaskState::Succeeded;
+    return succeeded;
+}
+
+void StartupGraph::report() const
+{
+    for (const Task& task : _tasks) {
+        std::cout << "Startup: " << task.name;
+        if (task.state == TaskState::Skipped) std::cout << " skipped.\r\n";
+        else std::cout << (task.state == TaskState::Failed ? " failed" : "") << " " << (task.start - _origin) * 1000.0
+            << " ms to " << (task.end - _origin) * 1000.0 << " ms" << (task.mainThread ? " on main thread" : "") << ".\r\n";
+    }
+}
+
+void StartupGraph::launch(int task, ThreadPool& pool)
+{
+    if (_tasks[task].mainThread) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _mainReady.push_back(task);
+        _changed.notify_all();
+    }
+    else pool.submit([this, task, &pool](int) { execute(task, pool); });
+}
+
+void StartupGraph::execute(int task, ThreadPool& pool)
+{
+    Task& t = _tasks[task];
+    t.start = steadySeconds();
+    bool succeeded = t.fn();
+    t.end = steadySeconds();
+
+    //Dependents are released outside the lock, launching takes it again
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        t.state = succeeded ? TaskState::Succeeded : TaskState::Failed;
+        _finished++;
+        for (int dependent : t.dependents) {
+            if (!succeeded) skip(dependent);
+            else if (--_tasks[dependent].unfinished == 0 && _tasks[dependent].state == TaskState::Waiting)
+                ready.push_back(dependent);
+        }
+        _changed.notify_all();
+    }
+    for (int dependent : ready) launch(dependent, pool);
+}
+
+void StartupGraph::skip(int task)
+{
+    //Called with the lock held
+    if (_tasks[task].state != TaskState::Waiting) return;
+    _tasks[task].state = TaskState::Skipped;
+    _finished++;
+    for (int dependent : _tasks[task].dependents) skip(dependent);
+}
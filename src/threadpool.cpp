@@ -0,0 +1,90 @@
+#include "threadpool.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+//Work shared between the caller & helpers of one parallelFor
+struct ParallelForState {
+    std::function<void(int, int)> fn;
+    int tasks;
+    std::atomic<int> next;
+    std::atomic<int> done;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+//Pull tasks until none are left, waking the caller after the last one completes
+static void runTasks(ParallelForState& state, int worker)
+{
+    int task;
+    while ((task = state.next.fetch_add(1)) < state.tasks) {
+        state.fn(task, worker);
+        if (state.done.fetch_add(1) + 1 == state.tasks) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished.notify_all();
+        }
+    }
+}
+
+ThreadPool::ThreadPool(unsigned int threads) : _stopping(false)
+{
+    if (!threads) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threads = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (unsigned int i = 0; i < threads; i++)
+        _workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (std::thread& worker : _workers) worker.join();
+}
+
+void ThreadPool::parallelFor(int tasks, const std::function<void(int, int)>& fn)
+{
+    if (tasks <= 0) return;
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->fn = fn;
+    state->tasks = tasks;
+    state->next = 0;
+    state->done = 0;
+
+    //Helpers that start after all tasks are taken return straight away
+    int helpers = std::min(tasks - 1, (int)_workers.size());
+    for (int i = 0; i < helpers; i++)
+        submit([state](int worker) { runTasks(*state, worker); });
+    runTasks(*state, 0);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]() { return state->done.load() == tasks; });
+}
+
+void ThreadPool::submit(std::function<void(int)> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+    while (true) {
+        std::function<void(int)> job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+            if (_stopping && _jobs.empty()) return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        job(worker);
+    }
+}
@@ -0,0 +1,104 @@
+#include "uploadworker.h"
+#include <chrono>
+#include <cfloat>
+
+#include "glad/glad.h"
+
+UploadWorker::UploadWorker(std::function<void()> makeCurrent, std::function<void()> releaseCurrent)
+        : _makeCurrent(makeCurrent), _releaseCurrent(releaseCurrent), _running(false) {}
+
+UploadWorker::~UploadWorker()
+{
+    stop();
+}
+
+void UploadWorker::start()
+{
+    _running = true;
+    _thread = std::thread(&UploadWorker::run, this);
+}
+
+void UploadWorker::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _wake.notify_one();
+    if (_thread.joinable()) _thread.join();
+}
+
+bool UploadWorker::push(const UploadJob& job)
+{
+    if (!_jobs.push(job)) return false;
+    //Lock so the wake can't land between the worker's empty check & its wait
+    std::lock_guard<std::mutex> lock(_mutex);
+    _wake.notify_one();
+    return true;
+}
+
+bool UploadWorker::pop(UploadResult& result)
+{
+    return _results.pop(result);
+}
+
+void UploadWorker::run()
+{
+    _makeCurrent();
+    UploadJob job;
+    while (true) {
+        while (_jobs.pop(job)) upload(job);
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_running) break;
+        _wake.wait(lock, [&]() { return !_running || !_jobs.empty(); });
+    }
+    _releaseCurrent();
+}
+
+void UploadWorker::upload(const UploadJob& job)
+{
+    UploadResult result;
+    result.job = job;
+    if (job.type == UploadType::ChunkUpload) {
+        //Always a fresh buffer, the render thread may still be drawing from the old one
+        glGenBuffers(1, &result.object);
+        glBindBuffer(GL_ARRAY_BUFFER, result.object);
+        glBufferData(GL_ARRAY_BUFFER, job.instances->size() * sizeof(SquareData), job.instances->data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        //Bounds for culling on the render thread, squares extend half a block from their block's center
+        result.min = glm::vec3(FLT_MAX);
+        result.max = glm::vec3(-FLT_MAX);
+        for (const SquareData& square : *job.instances) {
+            glm::vec3 pos = {square.pos[0], square.pos[1], square.pos[2]};
+            result.min = glm::min(result.min, pos);
+            result.max = glm::max(result.max, pos + 1.0f);
+        }
+    }
+    else {
+        glGenTextures(1, &result.object);
+        glBindTexture(GL_TEXTURE_2D, result.object);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, job.width, job.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, job.pixels.get());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    //Flush so the fence reaches the GPU, the render context can't flush ours
+    result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    //Render thread drains results every frame, so a full queue only waits briefly
+    while (!_results.push(result)) {
+        if (!_running) {
+            //Stopping, nothing will take the result, so its objects are deleted here on the context that made them
+            if (job.type == UploadType::ChunkUpload) glDeleteBuffers(1, &result.object);
+            else glDeleteTextures(1, &result.object);
+            glDeleteSync((GLsync)result.fence);
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}